@@ -5,10 +5,14 @@
  * Supports up to 5 players
  * 5 Buttons (pins 8-12) and 5 APA102 lighstrips (clock - pin 2, signals - pins 3-7) + a status APA102 strip on pin A5 (with a clock on A3) 
  * or a single LED on pin 13
+ * The player strips are clocked out in parallel by showStrips(), the status strip by showStatus()
+ * Nothing is buffered, the pixels are generated from a few bytes of state while they are sent out
+ * That leaves enough RAM for a bigger serial RX buffer, which the core only takes as a build flag:
+ *   arduino-cli compile -b arduino:avr:uno --build-property compiler.cpp.extra_flags=-DSERIAL_RX_BUFFER_SIZE=256
  * 
  * NOTE: The APA102 light strips that were in mind when making this project had alternating RGB and W pixels.
  *       Also for some reason 3 of the strips had addresses in the reverse order to the rest so I had to implement extra code for that
- *       To change the assignments of the reversed strips check the setStrip() function at line 70
+ *       To change the assignments of the reversed strips check the stripLit() function
  *       These lightstrips were not daisy-chainable. 
  *       Initially I tried to connect +5V,clock and GND lines of multiple strips together, with separate wires for data, but settled for
  *       a solution, where each strip is connected to a central lighting break-out box
@@ -18,261 +22,819 @@
 #define DISABLE_STARTUP_SEQUENCE false //change to true to disable startup test sequence
 
  
-#define FASTLED_ALLOW_INTERRUPTS 0
-#include <FastLED.h>
+#include "protocol.h"
 
 #define NUM_LEDS 82
-#define STATUS_LEDS 10 //had to reduce the amount of leds to 10 due to memory issues
-
-CRGB strips[5][NUM_LEDS];
-CRGB statusStrip[STATUS_LEDS]; 
+#define BRIGHTNESS 20
+#define STATUS_LEDS 82 //the full strip again, the pixels aren't stored anywhere anymore
 
 bool testMode = true;
 bool expectingAnswers = false;
 
 PROGMEM const int playerColors[5][3] = {{255,0,0},{127,255,0},{0,255,0},{0,255,255},{255,0,255}};
 
-void setup() {
-  delay(3000); // 3 second delay for recovery
+//buzzer capture
+//pins 8-12 are PB0-PB4, pin 8 (PB0) is player 4 and pin 12 (PB4) is player 0
+#define BUZZ_MASK 0x1F
+#define BUZZ_RING 16 //must be a power of 2
+#define PENALTY_US 1000000UL //lockout for holding the button down when answers open
 
-  //player strips
-  FastLED.addLeds<APA102, 3, 2, BGR>(strips[0], NUM_LEDS);
-  FastLED.addLeds<APA102, 4, 2, BGR>(strips[1], NUM_LEDS);
-  FastLED.addLeds<APA102, 5, 2, BGR>(strips[2], NUM_LEDS);
-  FastLED.addLeds<APA102, 6, 2, BGR>(strips[3], NUM_LEDS);
-  FastLED.addLeds<APA102, 7, 2, BGR>(strips[4], NUM_LEDS);
+struct BuzzEvent {
+  uint8_t pins; //PINB snapshot
+  unsigned long t; //micros() at the edge
+};
 
-  //statusstrip
-  FastLED.addLeds<APA102, A5, A3, BGR>(statusStrip, STATUS_LEDS); //separate pin due to signal reflection or something idk
+volatile BuzzEvent buzzRing[BUZZ_RING];
+volatile uint8_t buzzHead = 0;
+volatile uint8_t buzzTail = 0;
+uint8_t buzzPressed = 0; //pressed mask as of the last event handled by loop()
+unsigned long openTime = 0; //micros() timestamp since answers opened
+unsigned long penalties[5] = {0,0,0,0,0}; //micros() timestamp until which a player is locked out
+uint8_t penalised = 0; //players whose penalty hasn't run out, penalties[] is only looked at for them
 
-  //master brightness
-  FastLED.setBrightness(20);
+//every edge on pins 8-12 lands here, the port and the time are sampled together so
+//simultaneous presses share one snapshot and nothing depends on the order of checks
+ISR(PCINT0_vect)
+{
+  uint8_t pins = PINB;
+  unsigned long t = micros(); //4us resolution on a 16MHz uno
+  uint8_t next = (buzzHead+1) & (BUZZ_RING-1);
+  if (next != buzzTail) //drop the edge if loop() is that far behind, the first ones are what matter
+  {
+    buzzRing[buzzHead].pins = pins;
+    buzzRing[buzzHead].t = t;
+    buzzHead = next;
+  }
+}
 
-  //other pin shenanigans
-  pinMode(8, INPUT_PULLUP);
-  pinMode(9, INPUT_PULLUP);
-  pinMode(10, INPUT_PULLUP);
-  pinMode(11, INPUT_PULLUP);
-  pinMode(12, INPUT_PULLUP);
-  pinMode(13, OUTPUT);
-  Serial.begin(9600);
+//serial protocol, see protocol.h
+ProtoDecoder cmdDecoder;
 
-  //startup sequence to make sure that all lights work properly
-  #if DISABLE_STARTUP_SEQUENCE
-    digitalWrite(13,HIGH);
-    testMode=false;
-  #else
-    startupSequence();
-  #endif
+void sendMessage(uint8_t opcode, const uint8_t* payload, uint8_t len)
+{
+  uint8_t frame[PROTO_MAX_FRAME];
+  uint8_t n = protoEncode(opcode, payload, len, frame);
+  Serial.write(frame, n);
+}
+
+uint8_t reportedState = 0;
+
+//state goes out on transitions only, the heartbeat repeats it in case a frame got lost
+void reportState(uint8_t state)
+{
+  if (state != reportedState)
+  {
+    reportedState = state;
+    sendMessage(MSG_STATE, &state, 1);
+  }
+}
+
+void sendBuzz(int playerNumber, unsigned long delta)
+{
+  uint8_t payload[9];
+  payload[0] = playerNumber;
+  protoPutU32(payload+1, delta);
+  protoPutU32(payload+5, openTime+delta); //lets the host put the press on its own clock
+  sendMessage(MSG_BUZZ, payload, 9);
+}
+
+uint8_t cmdSeq = 0; //seq of the last game command, acked at the end of the loop() that ran it
+uint8_t cmdOpcode = 0; //and what it was, a repeat has to match both
+uint8_t cmdStateBefore = 0; //the state it found, the host can tell from it whether it did anything
+
+void sendAck(uint8_t seq, uint8_t opcode)
+{
+  uint8_t payload[4] = {seq, opcode, reportedState, cmdStateBefore};
+  sendMessage(MSG_ACK, payload, 4);
+}
+
+//returns the next complete command or 0, never waits for more bytes
+//pings and identify requests are answered in here so they don't depend on what state we're in,
+//so are repeats of the last game command, the host didn't get the ack and it must not run twice
+uint8_t readCommand()
+{
+  while (Serial.available())
+  {
+    const ProtoMessage* msg = protoFeed(&cmdDecoder, Serial.read());
+    if (msg)
+    {
+      if (msg->opcode==CMD_PING && msg->len >= 4)
+      {
+        unsigned long now = micros();
+        uint8_t payload[8];
+        memcpy(payload, msg->payload, 4);
+        protoPutU32(payload+4, now);
+        sendMessage(MSG_PONG, payload, 8);
+        continue;
+      }
+      if (msg->opcode==CMD_IDENTIFY)
+      {
+        //a host that just opened the port, its seqs have nothing to do with the last one's
+        cmdSeq = 0;
+        cmdOpcode = 0;
+        uint8_t payload[5];
+        memcpy(payload, PROTO_SIGNATURE, 4);
+        payload[4] = PROTO_VERSION;
+        sendMessage(MSG_IDENTITY, payload, 5);
+        continue;
+      }
+      if (msg->len < 1 || msg->payload[0] == 0)
+      {
+        continue; //game commands without a seq come from an older host
+      }
+      if (msg->payload[0] == cmdSeq && msg->opcode == cmdOpcode)
+      {
+        sendAck(cmdSeq, cmdOpcode);
+        continue;
+      }
+      cmdSeq = msg->payload[0];
+      cmdOpcode = msg->opcode;
+      return msg->opcode;
+    }
+  }
+  return 0;
+}
+
+
+//cooperative scheduler, nothing in loop() blocks so buttons and commands are handled every iteration
+//each task's run() is called every interval ms with an increasing step number and returns false when it's done
+#define TASK_COUNTDOWN 0
+#define TASK_STARTUP 1
+#define TASK_HEARTBEAT 2
+#define TASK_STATUS 3
+#define TASK_COUNT 4
+
+#define COUNTDOWN_STEPS 41
+#define COUNTDOWN_MS 150
+#define STARTUP_MS 10
+#define FRAME_MS 20 //the status task pushes at most one led frame per this many ms
+
+struct Task {
+  bool (*run)(uint16_t step);
+  uint16_t interval;
+  uint16_t step;
+  unsigned long last;
+  bool active;
+};
+
+bool countdownTask(uint16_t step);
+bool startupTask(uint16_t step);
+bool heartbeatTask(uint16_t step);
+bool statusTask(uint16_t step);
+
+//used before they're defined, the IDE would generate these but the simulator (arduino/sim) builds the sketch as plain C++
+void endAnswer();
+void answerLedsOff();
+void closeRound();
+void flushBuzzers();
+
+Task tasks[TASK_COUNT] = {
+  {countdownTask, COUNTDOWN_MS, 0, 0, false},
+  {startupTask, STARTUP_MS, 0, 0, false},
+  {heartbeatTask, HEARTBEAT_MS, 0, 0, true},
+  {statusTask, FRAME_MS, 0, 0, true} //last so it shows whatever the other tasks changed this tick
+};
+
+void startTask(uint8_t id, uint16_t interval)
+{
+  tasks[id].interval = interval;
+  tasks[id].step = 0;
+  tasks[id].last = millis() - interval; //first step on the next tick
+  tasks[id].active = true;
+}
+
+void stopTask(uint8_t id)
+{
+  tasks[id].active = false;
+}
+
+void runTasks()
+{
+  unsigned long now = millis();
+  for (uint8_t id = 0; id < TASK_COUNT; id++)
+  {
+    if (tasks[id].active && now - tasks[id].last >= tasks[id].interval)
+    {
+      tasks[id].last += tasks[id].interval;
+      if (now - tasks[id].last >= tasks[id].interval) //don't try to catch up after a stall
+      {
+        tasks[id].last = now;
+      }
+      tasks[id].active = tasks[id].run(tasks[id].step++);
+    }
+  }
+}
+
+
+bool heartbeatTask(uint16_t)
+{
+  sendMessage(MSG_HEARTBEAT, &reportedState, 1);
+  return true;
 }
 
 
-void setStrip(int stripNum, int index, int r, int g, int b) {
+//status strip modes
+#define STATUS_OFF 0
+#define STATUS_OPEN 1 //white, answers open or testing
+#define STATUS_PLAYER 2 //+ player number, player color while answering
+
+//there are no framebuffers, every pixel is worked out from these while it's being clocked out
+//a player strip is lit on its odd leds up to the fill mark, minus what the countdown has eaten from both ends
+uint8_t stripFill[5] = {0,0,0,0,0}; //odd leds lit from the start of the strip, LIT_LEDS is the whole strip
+uint8_t stripCountdown[5] = {0,0,0,0,0}; //countdown steps taken, each one clears a led from both ends
+uint8_t statusMode = STATUS_OFF;
+uint8_t shownStatus = 0xFF;
+uint8_t statusWipe = 0; //odd status leds already switched off by the end of the startup sequence
+bool stripsDirty = true;
+bool statusDirty = true;
+int answeringPlayer = -1;
+
+#define LIT_LEDS (NUM_LEDS/2)
+
+//player color channel (0 r, 1 g, 2 b) at the master brightness
+uint8_t playerChannel(int playerNumber, int channel)
+{
+  return (pgm_read_word(&playerColors[playerNumber][channel]) * (BRIGHTNESS+1)) >> 8;
+}
+
+bool stripLit(int stripNum, int index) {
   if (stripNum == 3 || stripNum == 4) //reversed + longer strips
   {
     index = NUM_LEDS - 1 - index; //there's actually a slight problem with this, but I can't be bothered to fix it
     //if you haven't noticed it so far, then don't bother looking for it, it's such a minor issue
   }
-  strips[stripNum][index] = CRGB(r,g,b);
+  uint8_t k = stripCountdown[stripNum];
+  return (index & 1) && index < 2*stripFill[stripNum] && index > k && index < NUM_LEDS - k;
+}
+
+void fillStrip(int stripNum, uint8_t fill)
+{
+  stripFill[stripNum] = fill;
+  stripCountdown[stripNum] = 0;
+  stripsDirty = true;
+}
+
+void clearStrip(int stripNum)
+{
+  fillStrip(stripNum, 0);
+}
+
+void countdownStep(int playerNumber, int e)
+{
+  stripCountdown[playerNumber] = e+1;
+  stripsDirty = true;
+}
+
+void setStatus(uint8_t mode)
+{
+  statusMode = mode;
+  statusWipe = 0;
+}
+
+//player strips, all five share the clock on pin 2 (PD2) and have their data on pins 3-7 (PD3-PD7)
+//so every PORTD write puts the same bit of all five strips on the wire and one clock edge latches them
+//APA102 is clocked so interrupts can stay on, an ISR in the middle just stretches a clock cycle
+#define LANE_CLOCK _BV(2)
+
+static inline void shiftLanes(uint8_t base, uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4) __attribute__((always_inline));
+static inline void shiftLanes(uint8_t base, uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4)
+{
+  for (uint8_t bit = 0x80; bit; bit >>= 1)
+  {
+    uint8_t out = base;
+    if (b0 & bit) out |= _BV(3);
+    if (b1 & bit) out |= _BV(4);
+    if (b2 & bit) out |= _BV(5);
+    if (b3 & bit) out |= _BV(6);
+    if (b4 & bit) out |= _BV(7);
+    PORTD = out; //data with the clock low
+    PORTD = out | LANE_CLOCK; //strips sample on the rising edge
+  }
 }
 
-#if !(DISABLE_STARTUP_SEQUENCE)
-  void startupSequence() {
-    for (int i = 1; i < 10; i+=1)
+void showStrips()
+{
+  uint8_t base = PORTD & 0x03; //leave the serial pins alone
+  uint8_t color[5][3]; //BGR wire order
+  for (int e = 0; e < 5; e++)
+  {
+    for (int c = 0; c < 3; c++)
     {
-      statusStrip[i] = CRGB(0,0,0);    
-    }    
-    FastLED.show();
+      color[e][c] = playerChannel(e, 2-c);
+    }
+  }
+
+  //start frame
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    shiftLanes(base, 0, 0, 0, 0, 0);
+  }
+  for (uint8_t i = 0; i < NUM_LEDS; i++)
+  {
+    uint8_t lit = 0;
     for (int e = 0; e < 5; e++)
     {
-      for (int i = 1; i < NUM_LEDS; i+=2)
-      {    
-        setStrip(e,i,pgm_read_word(&playerColors[e][0]), pgm_read_word(&playerColors[e][1]), pgm_read_word(&playerColors[e][2]));    
-        FastLED.show();
+      if (stripLit(e, i))
+      {
+        lit |= _BV(e);
       }
-      answerCountDown(e,10);
-    }
-    
-    for (int i = 1; i < STATUS_LEDS; i+=2)
-    {
-      statusStrip[i] = CRGB(255,255,255);    
     }
-    FastLED.show();
-    
-    delay(3000);
-    for (int i = 1; i < STATUS_LEDS; i+=2)
+    //full global brightness, the colors are scaled instead like FastLED used to
+    shiftLanes(base, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF);
+    for (uint8_t c = 0; c < 3; c++)
     {
-      statusStrip[i] = CRGB(0,0,0);    
-      FastLED.show();
+      shiftLanes(base, (lit & 0x01) ? color[0][c] : 0, (lit & 0x02) ? color[1][c] : 0, (lit & 0x04) ? color[2][c] : 0, (lit & 0x08) ? color[3][c] : 0, (lit & 0x10) ? color[4][c] : 0);
     }
-    
-    digitalWrite(13, HIGH);
   }
-#endif
+  //end frame, one extra clock edge per 2 leds to push the data through to the end of the strip
+  for (uint8_t i = 0; i < NUM_LEDS/16 + 1; i++)
+  {
+    shiftLanes(base, 0, 0, 0, 0, 0);
+  }
+  PORTD = base; //clock idles low
+}
 
+//status strip, data on A5 (PC5) and clock on A3 (PC3)
+#define STATUS_DATA _BV(5)
+#define STATUS_CLOCK _BV(3)
 
+void shiftStatus(uint8_t base, uint8_t b)
+{
+  for (uint8_t bit = 0x80; bit; bit >>= 1)
+  {
+    uint8_t out = (b & bit) ? base | STATUS_DATA : base;
+    PORTC = out;
+    PORTC = out | STATUS_CLOCK;
+  }
+}
 
-void initAnswer(int playerNumber)
+void showStatus()
 {
-  for (int i = 1; i < NUM_LEDS; i+=2)
+  uint8_t base = PORTC & ~(STATUS_DATA | STATUS_CLOCK);
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    shiftStatus(base, 0);
+  }
+  for (uint8_t i = 0; i < STATUS_LEDS; i++)
+  {
+    shiftStatus(base, 0xFF);
+    for (int c = 2; c >= 0; c--) //BGR
+    {
+      uint8_t v = 0;
+      if (statusMode == STATUS_OPEN && (i & 1) && i >= 2*statusWipe)
+      {
+        v = (255 * (BRIGHTNESS+1)) >> 8;
+      }
+      else if (statusMode >= STATUS_PLAYER && !(i & 1))
+      {
+        v = playerChannel(statusMode - STATUS_PLAYER, c);
+      }
+      shiftStatus(base, v);
+    }
+  }
+  for (uint8_t i = 0; i < STATUS_LEDS/16 + 1; i++)
   {
-    setStrip(playerNumber,i,pgm_read_word(&playerColors[playerNumber][0]), pgm_read_word(&playerColors[playerNumber][1]), pgm_read_word(&playerColors[playerNumber][2]));    
+    shiftStatus(base, 0);
   }
+  PORTC = base;
+}
 
-  //statusstrip off
-  for (int i = 1; i < STATUS_LEDS; i+=1) //1 just in case something glitches out
+//pushes whichever strips changed since the last frame
+bool statusTask(uint16_t)
+{
+  if (statusMode != shownStatus)
   {
-      statusStrip[i] = CRGB(0,0,0);    
+    shownStatus = statusMode;
+    statusDirty = true;
   }
-  //player color on status strip
-  for (int i = 0; i < STATUS_LEDS; i+=2)
+  if (stripsDirty)
+  {
+    showStrips();
+    stripsDirty = false;
+  }
+  if (statusDirty)
   {
-    statusStrip[i] = CRGB(pgm_read_word(&playerColors[playerNumber][0]),pgm_read_word(&playerColors[playerNumber][1]),pgm_read_word(&playerColors[playerNumber][2]));    
+    showStatus();
+    statusDirty = false;
   }
-  FastLED.show();
-  answerCountDown(playerNumber, 150);
+  return true;
 }
 
-void answerCountDown(int playerNumber, int interval)
+//startup sequence to make sure that all lights work properly
+//every player strip fills up one led at a time and counts down, then the status strip lights up for 3 seconds
+bool startupTask(uint16_t step)
 {
-  for (int e = 0; e<41; e++)
+  if (step < 5*NUM_LEDS)
   {
-    Serial.println(F("answering")); //should probably use bytes, but, eh
-    setStrip(playerNumber,e+1,0,0,0);
-    setStrip(playerNumber,NUM_LEDS-1-e,0,0,0);
-    FastLED.show();
-    delay(interval); 
-    if (Serial.available() && Serial.readString()==F("cancel")) //really should be using bytes
+    int e = step / NUM_LEDS;
+    int i = step % NUM_LEDS;
+    if (i < COUNTDOWN_STEPS)
+    {
+      fillStrip(e,i+1);
+    }
+    else
     {
-      interval = 0;
+      countdownStep(e,i-COUNTDOWN_STEPS);
     }
+    return true;
   }
-  answerLedsOff();
+
+  step -= 5*NUM_LEDS;
+  if (step == 0)
+  {
+    setStatus(STATUS_OPEN);
+    tasks[TASK_STARTUP].interval = 3000;
+    return true;
+  }
+  if (2*step - 1 < STATUS_LEDS) //then the white leds go off one by one
+  {
+    tasks[TASK_STARTUP].interval = STARTUP_MS;
+    statusWipe = step;
+    statusDirty = true;
+    return true;
+  }
+  setStatus(STATUS_OFF);
+  digitalWrite(13, HIGH);
+  return false;
 }
 
-void answerLedsOn()
+void stopStartup()
+{
+  stopTask(TASK_STARTUP);
+  for (int e = 0; e < 5; e++)
+  {
+    clearStrip(e);
+  }
+  setStatus(STATUS_OFF);
+}
+
+
+void initAnswer(int playerNumber)
+{
+  fillStrip(playerNumber, LIT_LEDS);
+
+  //player color on status strip
+  setStatus(STATUS_PLAYER + playerNumber);
+  answeringPlayer = playerNumber;
+  startTask(TASK_COUNTDOWN, COUNTDOWN_MS);
+}
+
+bool countdownTask(uint16_t step)
 {
-  for (int i = 1; i < STATUS_LEDS; i+=2)
+  if (step < COUNTDOWN_STEPS)
   {
-      statusStrip[i] = CRGB(255,255,255);    
+    countdownStep(answeringPlayer, step);
+    return true;
   }
-  FastLED.show();
+  endAnswer();
+  return false;
+}
+
+//also used to cancel, the strip goes dark on the next led frame
+void endAnswer()
+{
+  stopTask(TASK_COUNTDOWN);
+  clearStrip(answeringPlayer);
+  answerLedsOff();
+  answeringPlayer = -1;
+  closeRound();
+  flushBuzzers(); //presses during the countdown don't count for the next one
+}
+
+void answerLedsOn()
+{
+  setStatus(STATUS_OPEN);
 }
 
 void answerLedsOff()
 {
-  for (int i = 0; i < STATUS_LEDS; i+=1)
+  setStatus(STATUS_OFF);
+}
+
+uint8_t buzzBit(int playerNumber)
+{
+  return _BV(4-playerNumber);
+}
+
+//throw away queued edges and resync the pressed mask with the pins
+void flushBuzzers()
+{
+  noInterrupts();
+  buzzTail = buzzHead;
+  buzzPressed = ~PINB & BUZZ_MASK;
+  interrupts();
+}
+
+//press log of the current round, from answers opening until the answer is over
+//every player's first press that counted is kept, so the runners up are in there too
+bool roundOpen = false;
+uint8_t roundPressed = 0; //buzzBit() mask of players with a timed press
+uint8_t roundEarly = 0; //buzzBit() mask of players that jumped the gun
+uint8_t roundLocked = 0; //buzzBit() mask of players that answered wrong, their presses are ignored until the next round
+int roundWinner = -1;
+unsigned long roundDelta[5]; //micros since answers opened
+
+void openRound()
+{
+  roundOpen = true;
+  roundPressed = 0;
+  roundEarly = 0;
+  roundLocked = 0;
+  roundWinner = -1;
+}
+
+//the queue is the round's press log, the next one up is the earliest press that hasn't been locked out
+int nextInQueue()
+{
+  int next = -1;
+  for (int p = 0; p < 5; p++)
   {
-      statusStrip[i] = CRGB(0,0,0);    
+    if ((roundPressed & buzzBit(p)) && !(roundLocked & buzzBit(p)) && (next < 0 || roundDelta[p] < roundDelta[next]))
+    {
+      next = p;
+    }
   }
-  FastLED.show();
+  return next;
 }
 
-long int openTime = 0; //timestamp since answers opened
-long int penalties[5] = {0,0,0,0,0};
+//sends the round to the host, every player that pressed at all gets an entry
+void closeRound()
+{
+  if (!roundOpen)
+  {
+    return;
+  }
+  roundOpen = false;
+  uint8_t payload[1 + 5*6];
+  uint8_t n = 1;
+  payload[0] = 0;
+  for (int p = 0; p < 5; p++)
+  {
+    uint8_t flags = 0;
+    if (roundPressed & buzzBit(p)) flags |= PRESS_TIMED;
+    if (roundEarly & buzzBit(p)) flags |= PRESS_EARLY;
+    if (roundWinner == p) flags |= PRESS_WINNER;
+    if (roundLocked & buzzBit(p)) flags |= PRESS_WRONG;
+    if (flags)
+    {
+      payload[n] = p;
+      payload[n+1] = flags;
+      protoPutU32(payload+n+2, (flags & PRESS_TIMED) ? roundDelta[p] : 0);
+      n += 6;
+      payload[0]++;
+    }
+  }
+  sendMessage(MSG_PRESSES, payload, n);
+}
 
 void checkPlayerHolding() //check if player is holding down button before answers are open and penalise them
 {
-  if (digitalRead(8) == LOW)
+  uint8_t held = ~PINB & BUZZ_MASK;
+  for (int p = 0; p < 5; p++)
+  {
+    penalties[p] = openTime+PENALTY_US;
+  }
+  penalised = held;
+  roundEarly |= held;
+}
+
+void clearPenalties()
+{
+  penalised = 0;
+}
+
+//drains the capture ring, logs the presses for the round
+//and returns the player with the earliest eligible press (and its offset from openTime), or -1
+int pollBuzzers(unsigned long &winnerDelta)
+{
+  int winner = -1;
+  winnerDelta = 0;
+  while (buzzTail != buzzHead)
   {
-    penalties[4] = openTime+1000;
+    noInterrupts();
+    uint8_t pins = buzzRing[buzzTail].pins;
+    unsigned long t = buzzRing[buzzTail].t;
+    buzzTail = (buzzTail+1) & (BUZZ_RING-1);
+    interrupts();
+
+    uint8_t pressed = ~pins & BUZZ_MASK;
+    uint8_t edges = pressed & ~buzzPressed; //falling edges only
+    buzzPressed = pressed;
+    for (int p = 0; p < 5; p++)
+    {
+      if (!(edges & buzzBit(p)) || (roundLocked & buzzBit(p)))
+      {
+        continue;
+      }
+      //wrap safe comparisons, micros() rolls over every ~70 minutes, only good for about half of that,
+      //so the penalty is only compared while it's still running
+      if ((penalised & buzzBit(p)) && (long)(t-penalties[p]) < 0)
+      {
+        if (roundOpen)
+        {
+          roundEarly |= buzzBit(p);
+        }
+        continue;
+      }
+      unsigned long delta = t-openTime;
+      if (roundOpen && !(roundPressed & buzzBit(p)))
+      {
+        roundPressed |= buzzBit(p);
+        roundDelta[p] = delta;
+      }
+      if (winner < 0 || delta < winnerDelta)
+      {
+        winner = p;
+        winnerDelta = delta;
+      }
+    }
   }
-  if (digitalRead(9) == LOW)
+  //penalties that ran out are dropped right away, a player who sits it out doesn't get to the wrap
+  unsigned long now = micros();
+  for (int p = 0; p < 5; p++)
   {
-    penalties[3] = openTime+1000;
+    if ((penalised & buzzBit(p)) && (long)(now-penalties[p]) >= 0)
+    {
+      penalised &= ~buzzBit(p);
+    }
   }
-  if (digitalRead(10) == LOW)
+  return winner;
+}
+
+
+//wrong answer, the player is locked out for the rest of the round and the next one in the queue
+//gets the floor right away, if nobody else has pressed yet answers are open again
+void wrongAnswer()
+{
+  if (!roundOpen) //testing, nothing to hand over
   {
-    penalties[2] = openTime+1000;
+    endAnswer();
+    return;
   }
-  if (digitalRead(11) == LOW)
+  roundLocked |= buzzBit(answeringPlayer);
+  stopTask(TASK_COUNTDOWN);
+  clearStrip(answeringPlayer);
+  answeringPlayer = -1;
+
+  int next = nextInQueue();
+  if (next >= 0)
   {
-    penalties[1] = openTime+1000;
+    roundWinner = next; //PRESS_WINNER is whoever had the floor last
+    sendBuzz(next, roundDelta[next]);
+    initAnswer(next);
   }
-  if (digitalRead(12) == LOW)
+  else
   {
-    penalties[0] = openTime+1000;
+    expectingAnswers = true;
+    digitalWrite(13, HIGH);
+    answerLedsOn();
   }
 }
 
 
+void setup() {
+  //3 second delay for recovery, the host can already find us in the meantime (anything else sent now is dropped
+  //unacked, and forgotten so the host's retry of it runs once we're up)
+  Serial.begin(PROTO_BAUD);
+  unsigned long bootTime = millis();
+  while (millis() - bootTime < 3000)
+  {
+    readCommand();
+    cmdSeq = 0;
+    cmdOpcode = 0;
+  }
+
+  //player strips, see showStrips()
+  for (int pin = 2; pin <= 7; pin++)
+  {
+    pinMode(pin, OUTPUT);
+  }
+
+  //statusstrip, see showStatus()
+  pinMode(A5, OUTPUT); //separate pin due to signal reflection or something idk
+  pinMode(A3, OUTPUT);
+
+  //other pin shenanigans
+  pinMode(8, INPUT_PULLUP);
+  pinMode(9, INPUT_PULLUP);
+  pinMode(10, INPUT_PULLUP);
+  pinMode(11, INPUT_PULLUP);
+  pinMode(12, INPUT_PULLUP);
+  pinMode(13, OUTPUT);
+
+  //pin change interrupts on PCINT0-4 (pins 8-12)
+  PCMSK0 |= BUZZ_MASK;
+  PCIFR = _BV(PCIF0);
+  PCICR |= _BV(PCIE0);
+
+  //startup sequence to make sure that all lights work properly
+  #if DISABLE_STARTUP_SEQUENCE
+    digitalWrite(13,HIGH);
+    testMode=false;
+  #else
+    startTask(TASK_STARTUP, STARTUP_MS);
+  #endif
+  flushBuzzers();
+}
+
+//the state the next loop() will report, what an ack says the command led to
+uint8_t currentState()
+{
+  if (answeringPlayer >= 0)
+  {
+    return STATE_ANSWERING;
+  }
+  if (tasks[TASK_STARTUP].active || testMode)
+  {
+    return STATE_TESTING;
+  }
+  return expectingAnswers ? STATE_ACCEPTING : STATE_IDLE;
+}
+
 void loop() {
-  if (testMode || expectingAnswers)
-  { 
-    if (testMode)
+  uint8_t cmd = readCommand();
+  if (cmd)
+  {
+    cmdStateBefore = currentState();
+  }
+  unsigned long delta;
+  int winner = pollBuzzers(delta); //always drained so the ring never backs up
+
+  if (answeringPlayer >= 0)
+  {
+    reportState(STATE_ANSWERING);
+    if (cmd==CMD_CANCEL || cmd==CMD_STOP)
     {
-      Serial.println(F("testing")); //who uses bytes anyway
+      endAnswer();
+      if (cmd==CMD_STOP)
+      {
+        testMode = false;
+      }
     }
-    if (expectingAnswers)
+    else if (cmd==CMD_WRONG)
     {
-      Serial.println(F("accepting")); //smh my head
+      wrongAnswer();
     }
-    
-    if (Serial.available() && Serial.readString()==F("stop")) //🚨🚨🚨 STRING USER DETECTED!!!! 🚨🚨🚨
+  }
+  else if (tasks[TASK_STARTUP].active)
+  {
+    reportState(STATE_TESTING);
+    if (cmd==CMD_STOP)
     {
+      stopStartup();
       testMode = false;
-      expectingAnswers = false;
-      answerLedsOff();
     }
+  }
+  else if (testMode || expectingAnswers)
+  { 
+    reportState(testMode ? STATE_TESTING : STATE_ACCEPTING);
     
-    
-    if (digitalRead(8) == LOW && millis()>penalties[4])
+    if (cmd==CMD_STOP)
     {
-      Serial.println(F("answering"));
-      digitalWrite(13, LOW);
-      expectingAnswers = false;
-      initAnswer(4);
-    }
-    if (digitalRead(9) == LOW && millis()>penalties[3])
-    {
-      Serial.println(F("answering"));
-      digitalWrite(13, LOW);
-      expectingAnswers = false;
-      initAnswer(3);
-    }
-    if (digitalRead(10) == LOW && millis()>penalties[2])
-    {
-      Serial.println(F("answering"));
-      digitalWrite(13, LOW);
-      expectingAnswers = false;
-      initAnswer(2);      
-    }
-    if (digitalRead(11) == LOW && millis()>penalties[1])
-    {
-      Serial.println(F("answering"));
-      digitalWrite(13, LOW);
+      testMode = false;
       expectingAnswers = false;
-      initAnswer(1);
+      answerLedsOff();
+      closeRound(); //nobody buzzed in time
     }
-    if (digitalRead(12) == LOW && millis()>penalties[0])
+    else if (winner >= 0)
     {
-      Serial.println(F("answering"));
+      sendBuzz(winner, delta);
+      reportState(STATE_ANSWERING);
+      roundWinner = winner;
       digitalWrite(13, LOW);
       expectingAnswers = false;
-      initAnswer(0);
+      initAnswer(winner);
     }
   }
   else
   {
     digitalWrite(13, LOW);
-    Serial.println(F("idle")); //lmao
-    if (Serial.available())
+    reportState(STATE_IDLE);
+    if (cmd==CMD_ACCEPT)
     {
-      String tring = Serial.readString();
-      if  (tring==F("accept")) //only real garbage programmers use strings
-      {
-        openTime = millis(); //set answer opening timestamp
-        checkPlayerHolding();
-        digitalWrite(13, HIGH);
-        expectingAnswers = true;
-        answerLedsOn();
-      }
-      else if (tring==F("test")) //bytes are overrated
-      {
-        digitalWrite(13, HIGH);
-        testMode = true;
-        answerLedsOn();
-      }
+      openTime = micros(); //set answer opening timestamp
+      flushBuzzers();
+      openRound();
+      checkPlayerHolding();
+      digitalWrite(13, HIGH);
+      expectingAnswers = true;
+      answerLedsOn();
+    }
+    else if (cmd==CMD_TEST)
+    {
+      digitalWrite(13, HIGH);
+      openTime = micros();
+      flushBuzzers();
+      clearPenalties();
+      testMode = true;
+      answerLedsOn();
     }
   }
+
+  if (cmd)
+  {
+    reportState(currentState());
+    sendAck(cmdSeq, cmd);
+  }
+  runTasks();
 }
@@ -0,0 +1,219 @@
+/*
+ * Jeopardy controller serial protocol
+ *
+ * Shared between the firmware and the PC controller (src/main.cpp includes this file directly),
+ * so keep it plain C++ without Arduino or STL dependencies.
+ *
+ * Every message is [opcode][payload...][crc8], COBS encoded and terminated by a 0x00 byte.
+ * The CRC is CRC-8 (poly 0x07) over the opcode and the payload, multi-byte values are little endian.
+ * A receiver that starts mid-frame or sees a corrupted frame just waits for the next 0x00.
+ */
+#ifndef JEOPARDY_PROTOCOL_H
+#define JEOPARDY_PROTOCOL_H
+
+#include <stdint.h>
+
+#define PROTO_BAUD 1000000 //exact on a 16MHz uno (115200 is 2% off), and a byte takes 10us instead of 87us
+#define PROTO_SIGNATURE "JPDY" //first 4 bytes of MSG_IDENTITY
+#define PROTO_VERSION 3 //bump whenever a message changes in a way the other side has to know about
+
+#define HEARTBEAT_MS 200 //firmware heartbeat period
+#define HEARTBEAT_TIMEOUT_MS (3*HEARTBEAT_MS) //silence after which the host treats the controller as gone
+
+#define PROTO_MAX_PAYLOAD 32
+#define PROTO_MAX_FRAME (PROTO_MAX_PAYLOAD + 4) //opcode + crc + cobs overhead + delimiter
+
+//firmware -> host
+#define MSG_STATE 0x01 //[state], only sent when the state changes
+#define MSG_BUZZ 0x02 //[player][u32 micros since answers opened][u32 micros() of the press]
+#define MSG_HEARTBEAT 0x03 //[state], every HEARTBEAT_MS
+#define MSG_PRESSES 0x04 //[count] + count * [player][flags][u32 micros since answers opened], after every round
+#define MSG_PONG 0x05 //[u32 echoed host tag][u32 micros()], answers CMD_PING right away in any state
+#define MSG_IDENTITY 0x06 //[PROTO_SIGNATURE][PROTO_VERSION], answers CMD_IDENTIFY right away in any state
+#define MSG_ACK 0x07 //[seq][command opcode][state after it ran][state before it], for every CMD_ACCEPT..CMD_WRONG
+
+//host -> firmware
+//game commands carry [seq] and are acked with MSG_ACK once loop() has handled them, a lost command or ack is
+//sent again with the same seq, which is acked again but not run twice. a repeat has the same seq and opcode
+//as the last command. seq 0 is never used, so it never matches what a freshly reset controller remembers,
+//and CMD_IDENTIFY, sent on every open, makes the controller forget the last one too
+//a command that means nothing in the state it finds (a wrong answer after the countdown ran out) is acked all the
+//same, the state before it in the ack tells the host whether it did anything
+#define CMD_ACCEPT 0x10 //[seq]
+#define CMD_STOP 0x11 //[seq]
+#define CMD_CANCEL 0x12 //[seq]
+#define CMD_TEST 0x13 //[seq]
+#define CMD_WRONG 0x14 //[seq], locks the answering player out and hands over to the next one in the queue
+#define CMD_PING 0x15 //[u32 host tag], for clock sync
+#define CMD_IDENTIFY 0x16 //lets the host tell the controller apart from whatever else is plugged in, resets the seq
+
+//MSG_PRESSES flags
+#define PRESS_TIMED 0x01 //the time is the player's first press that counted
+#define PRESS_EARLY 0x02 //held the button when answers opened or pressed during the lockout
+#define PRESS_WINNER 0x04 //the last player that had the floor, after a wrong answer that's the one it was handed to
+#define PRESS_WRONG 0x08 //got the floor and was marked wrong
+
+//states, the numbers match the status strings on the PC side
+#define STATE_IDLE 1
+#define STATE_ACCEPTING 2
+#define STATE_ANSWERING 3
+#define STATE_TESTING 4
+
+struct ProtoMessage {
+  uint8_t opcode;
+  uint8_t len;
+  uint8_t payload[PROTO_MAX_PAYLOAD + 1]; //+1, the decoder puts the crc after the payload
+};
+
+//streaming decoder, every byte is un-COBSed straight into msg as it arrives and checked against a running crc,
+//so a frame is never buffered and copied again, and a frame split over any number of reads just carries on
+struct ProtoDecoder {
+  ProtoMessage msg;
+  uint8_t n; //bytes of opcode + payload + crc decoded so far
+  uint8_t left; //data bytes left in the current cobs block, 0 when the next byte is a code byte
+  uint8_t code; //the current block's code byte, 0 at the start of a frame
+  uint8_t crc; //crc over the decoded bytes, including the received crc it comes out as 0
+  bool overflow; //frame too long or broken, skip until the next delimiter
+};
+
+//a nibble at a time, the table is small enough to keep on the uno and it beats going bit by bit
+static const uint8_t protoCrcNibble[16] = {0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D};
+
+static inline uint8_t protoCrc8(uint8_t crc, uint8_t byte)
+{
+  crc ^= byte;
+  crc = (uint8_t)(crc << 4) ^ protoCrcNibble[crc >> 4];
+  crc = (uint8_t)(crc << 4) ^ protoCrcNibble[crc >> 4];
+  return crc;
+}
+
+static inline void protoPutU32(uint8_t* out, uint32_t v)
+{
+  out[0] = v;
+  out[1] = v >> 8;
+  out[2] = v >> 16;
+  out[3] = v >> 24;
+}
+
+static inline uint32_t protoGetU32(const uint8_t* in)
+{
+  return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+//encodes a message into out (at least PROTO_MAX_FRAME bytes), returns the frame length including the delimiter
+static inline uint8_t protoEncode(uint8_t opcode, const uint8_t* payload, uint8_t len, uint8_t* out)
+{
+  if (len > PROTO_MAX_PAYLOAD)
+  {
+    return 0;
+  }
+  uint8_t crc = protoCrc8(0, opcode);
+  for (uint8_t i = 0; i < len; i++)
+  {
+    crc = protoCrc8(crc, payload[i]);
+  }
+
+  //cobs, code byte holds the distance to the next zero
+  uint8_t codePos = 0;
+  uint8_t code = 1;
+  uint8_t n = 1;
+  for (uint8_t i = 0; i < len + 2; i++)
+  {
+    uint8_t b = i == 0 ? opcode : (i == len + 1 ? crc : payload[i - 1]);
+    if (b == 0)
+    {
+      out[codePos] = code;
+      codePos = n++;
+      code = 1;
+    }
+    else
+    {
+      out[n++] = b;
+      code++;
+    }
+  }
+  out[codePos] = code;
+  out[n++] = 0;
+  return n;
+}
+
+static inline void protoReset(ProtoDecoder* d)
+{
+  d->n = 0;
+  d->left = 0;
+  d->code = 0;
+  d->crc = 0;
+  d->overflow = false;
+}
+
+static inline void protoPut(ProtoDecoder* d, uint8_t b)
+{
+  if (d->n >= PROTO_MAX_PAYLOAD + 2)
+  {
+    d->overflow = true;
+    return;
+  }
+  if (d->n == 0)
+  {
+    d->msg.opcode = b;
+  }
+  else
+  {
+    d->msg.payload[d->n - 1] = b;
+  }
+  d->n++;
+  d->crc = protoCrc8(d->crc, b);
+}
+
+//feeds one received byte, returns the message when it completed a valid frame, 0 otherwise
+//the message lives in the decoder and stays valid until the next byte is fed
+static inline const ProtoMessage* protoFeed(ProtoDecoder* d, uint8_t byte)
+{
+  if (byte == 0)
+  {
+    //delimiter, a good frame ended right on a block boundary with a crc that checks out
+    bool ok = !d->overflow && d->left == 0 && d->n >= 2 && d->crc == 0;
+    uint8_t n = d->n;
+    protoReset(d);
+    if (!ok)
+    {
+      return 0;
+    }
+    d->msg.len = n - 2;
+    return &d->msg;
+  }
+  if (d->left)
+  {
+    protoPut(d, byte);
+    d->left--;
+    return 0;
+  }
+
+  //code byte, the block before it stood for a zero unless it was a full 254 byte one
+  if (d->code && d->code < 0xFF)
+  {
+    protoPut(d, 0);
+  }
+  d->code = byte;
+  d->left = byte - 1;
+  return 0;
+}
+
+//feeds a read buffer in place until a message completes, *used is set to the bytes consumed so a whole read goes
+//  while (len) { msg = protoParse(d, data, len, &used); data += used; len -= used; if (msg) ... }
+static inline const ProtoMessage* protoParse(ProtoDecoder* d, const uint8_t* data, uint16_t len, uint16_t* used)
+{
+  for (uint16_t i = 0; i < len; i++)
+  {
+    const ProtoMessage* msg = protoFeed(d, data[i]);
+    if (msg)
+    {
+      *used = i + 1;
+      return msg;
+    }
+  }
+  *used = len;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Just enough of the Arduino core for jeopardy.ino to build on Linux, see sim.cpp
+ * Time only moves when the simulator says so, the registers the sketch touches are hooked
+ */
+#ifndef JEOPARDY_SIM_ARDUINO_H
+#define JEOPARDY_SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define A3 17
+#define A5 19
+
+#define PROGMEM
+#define pgm_read_word(addr) (*(addr))
+#define F(s) (s)
+#define _BV(bit) (1 << (bit))
+#define ISR(vector) void vector()
+
+#define PCIE0 0
+#define PCIF0 0
+
+//output port, every write goes through the simulator so it can decode what the strips would show
+struct SimPort {
+  uint8_t value;
+  uint8_t id;
+  SimPort& operator=(uint8_t v);
+  operator uint8_t() const { return value; }
+};
+
+extern SimPort PORTC;
+extern SimPort PORTD;
+extern volatile uint8_t PINB; //buttons, driven by the simulator
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCIFR;
+extern volatile uint8_t PCICR;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void noInterrupts();
+void interrupts();
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  size_t write(uint8_t byte);
+  size_t write(const uint8_t* buffer, size_t size);
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,979 @@
+/*
+ * Jeopardy firmware simulator
+ *
+ * Builds jeopardy.ino against the fake core in Arduino.h with a virtual clock and plays scripted or random
+ * rounds against it way faster than real time. Everything is checked from the outside like the PC would see it:
+ * the serial frames, plus the LED output decoded from the clock and data pins.
+ *
+ *   make sim
+ *   bin/linux/jeopardysim [--rounds N] [--seed N] [--script file] [--verbose]
+ *
+ * Script lines are "<ms> <what> [player]", time 0 is right after the startup sequence:
+ *   500 accept          (accept, stop, cancel, wrong, test are sent as commands)
+ *   812.25 press 3      (press/release, players 1-5 like on the PC)
+ *   1000 expect buzz 3  (the last buzz was player 3)
+ *   1000 expect state answering
+ *
+ * The timing figures come from a model, not a board: LOOP_NS for every pass through loop(), EDGE_NS for every
+ * bit clocked out to the strips and the serial line at PROTO_BAUD with the core's 64 byte buffers.
+ * unsigned long is 64 bits here, so micros() doesn't wrap like it does on the Uno.
+ */
+#include "Arduino.h"
+#include "../jeopardy/jeopardy.ino"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define LOOP_NS 12000ULL //one pass through loop() with nothing to do, a rough guess for ~200 instructions at 16MHz
+#define EDGE_NS 1250ULL //one bit out of shiftLanes()/shiftStatus(), ~20 cycles
+#define AVAILABLE_NS 250ULL //one Serial.available(), so loops that only poll the serial port still move the clock
+#define BYTE_NS (10ULL*1000000000ULL/PROTO_BAUD) //8N1
+#define SERIAL_BUFFER 64
+#define IDLE_SKIP_NS 1000000ULL //a pass that did nothing lets the clock jump ahead this far at most
+#define MS 1000000ULL
+
+//virtual clock in ns
+uint64_t simNow = 0;
+bool simSkipIdle = true;
+bool simVerbose = false;
+
+//hooked registers
+SimPort PORTC = {0, 'C'};
+SimPort PORTD = {0, 'D'};
+volatile uint8_t PINB = 0x1F; //pull-ups, nothing pressed
+volatile uint8_t PCMSK0 = 0;
+volatile uint8_t PCIFR = 0;
+volatile uint8_t PCICR = 0;
+HardwareSerial Serial;
+
+bool simInterrupts = true;
+bool simPcintPending = false;
+bool simLed13 = false;
+
+struct SimStats {
+  uint64_t loops = 0;
+  uint64_t loopNs = 0;
+  uint64_t loopMaxNs = 0;
+  uint64_t skippedNs = 0;
+  uint64_t laneEdges = 0;
+  uint64_t statusEdges = 0;
+  uint64_t isrs = 0;
+  uint64_t txBytes = 0;
+  uint64_t rxBytes = 0;
+  uint64_t rxOverflows = 0;
+  uint64_t txBlockedNs = 0;
+  uint64_t heartbeats = 0;
+  uint64_t heartbeatGapMaxNs = 0;
+  uint64_t lastHeartbeat = 0;
+  uint64_t darkCount = 0;
+  uint64_t darkTotalNs = 0;
+  uint64_t darkMaxNs = 0;
+  uint64_t acks = 0;
+  uint64_t ackTotalNs = 0;
+  uint64_t ackMaxNs = 0;
+  uint64_t repeats = 0; //commands sent twice, like after a lost ack
+  uint64_t repeatAcks = 0;
+  uint64_t unacked = 0;
+} simStats;
+
+//APA102 decoder for one strip, fed a data bit on every rising clock edge
+struct SimStrip {
+  int count; //leds in a frame
+  bool inFrame = false;
+  int zeros = 0;
+  uint32_t word = 0;
+  int bits = 0;
+  int led = 0;
+  int building = 0;
+  uint32_t buildingColor = 0;
+
+  int lit = 0; //lit leds in the last complete frame
+  uint32_t color = 0; //BGR of a lit led in the last complete frame
+  uint64_t frames = 0;
+  uint64_t frameAt = 0; //when the last complete frame finished
+
+  void clock(int bit)
+  {
+    if (!inFrame)
+    {
+      if (!bit)
+      {
+        zeros++;
+      }
+      else if (zeros >= 32) //start frame done, this is the first bit of the first led
+      {
+        inFrame = true;
+        word = 1;
+        bits = 1;
+        led = 0;
+        building = 0;
+        buildingColor = 0;
+      }
+      else
+      {
+        zeros = 0;
+      }
+      return;
+    }
+    word = (word << 1) | bit;
+    if (++bits < 32)
+    {
+      return;
+    }
+    bits = 0;
+    if ((word >> 29) != 7) //not a led frame, back to waiting for a start frame
+    {
+      inFrame = false;
+      zeros = word == 0 ? 32 : 0;
+      return;
+    }
+    if (word & 0xFFFFFF)
+    {
+      building++;
+      buildingColor = word & 0xFFFFFF;
+    }
+    word = 0;
+    if (++led == count)
+    {
+      lit = building;
+      color = buildingColor;
+      frames++;
+      frameAt = simNow;
+      inFrame = false;
+      zeros = 0;
+    }
+  }
+};
+
+SimStrip simLanes[5] = {{NUM_LEDS}, {NUM_LEDS}, {NUM_LEDS}, {NUM_LEDS}, {NUM_LEDS}};
+SimStrip simStatus = {STATUS_LEDS};
+
+//button timeline
+struct SimEvent {
+  uint64_t t;
+  int player;
+  bool pressed;
+};
+
+struct SimLaterFirst {
+  bool operator()(const SimEvent& a, const SimEvent& b) const { return a.t > b.t; }
+};
+
+std::priority_queue<SimEvent, std::vector<SimEvent>, SimLaterFirst> simEvents;
+
+void simSchedule(uint64_t t, int player, bool pressed)
+{
+  simEvents.push({t, player, pressed});
+}
+
+void simApply(const SimEvent& e)
+{
+  uint8_t bit = _BV(4 - e.player);
+  uint8_t pins = e.pressed ? (PINB & ~bit) : (PINB | bit);
+  if (pins == PINB)
+  {
+    return;
+  }
+  PINB = pins;
+  if ((PCICR & _BV(PCIE0)) && (PCMSK0 & bit))
+  {
+    if (simInterrupts)
+    {
+      simStats.isrs++;
+      PCINT0_vect();
+    }
+    else
+    {
+      simPcintPending = true;
+    }
+  }
+}
+
+//moves the clock forward, button edges in between fire the interrupt at their exact time
+void simAdvance(uint64_t ns)
+{
+  uint64_t target = simNow + ns;
+  while (!simEvents.empty() && simEvents.top().t <= target)
+  {
+    SimEvent e = simEvents.top();
+    simEvents.pop();
+    simNow = std::max(simNow, e.t);
+    simApply(e);
+  }
+  simNow = target;
+}
+
+//fake core
+unsigned long millis()
+{
+  return simNow / 1000000;
+}
+
+unsigned long micros()
+{
+  return (simNow / 1000) & ~3ULL; //4us steps like timer0 on a 16MHz uno
+}
+
+void delay(unsigned long ms)
+{
+  simAdvance(ms * MS);
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin == 13)
+  {
+    simLed13 = value;
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  return (pin >= 8 && pin <= 12) ? (PINB >> (pin - 8)) & 1 : LOW;
+}
+
+void noInterrupts()
+{
+  simInterrupts = false;
+}
+
+void interrupts()
+{
+  simInterrupts = true;
+  if (simPcintPending)
+  {
+    simPcintPending = false;
+    simStats.isrs++;
+    PCINT0_vect();
+  }
+}
+
+SimPort& SimPort::operator=(uint8_t v)
+{
+  uint8_t old = value;
+  value = v;
+  if (id == 'D' && !(old & _BV(2)) && (v & _BV(2)))
+  {
+    for (int e = 0; e < 5; e++)
+    {
+      simLanes[e].clock((v >> (3 + e)) & 1);
+    }
+    simStats.laneEdges++;
+    simAdvance(EDGE_NS);
+  }
+  if (id == 'C' && !(old & _BV(3)) && (v & _BV(3)))
+  {
+    simStatus.clock((v >> 5) & 1);
+    simStats.statusEdges++;
+    simAdvance(EDGE_NS);
+  }
+  return *this;
+}
+
+//serial line, host -> firmware bytes carry their arrival time
+std::deque<std::pair<uint64_t, uint8_t>> simRxLine;
+std::deque<uint8_t> simRxBuffer;
+uint64_t simRxLineFree = 0;
+uint64_t simTxDrained = 0; //when the firmware's TX buffer will be empty
+
+void simRxArrive()
+{
+  while (!simRxLine.empty() && simRxLine.front().first <= simNow)
+  {
+    if (simRxBuffer.size() < SERIAL_BUFFER)
+    {
+      simRxBuffer.push_back(simRxLine.front().second);
+    }
+    else
+    {
+      simStats.rxOverflows++;
+    }
+    simRxLine.pop_front();
+  }
+}
+
+void HardwareSerial::begin(unsigned long)
+{
+}
+
+int HardwareSerial::available()
+{
+  simAdvance(AVAILABLE_NS);
+  simRxArrive();
+  return simRxBuffer.size();
+}
+
+int HardwareSerial::read()
+{
+  simRxArrive();
+  if (simRxBuffer.empty())
+  {
+    return -1;
+  }
+  uint8_t b = simRxBuffer.front();
+  simRxBuffer.pop_front();
+  simStats.rxBytes++;
+  return b;
+}
+
+void simHostReceive(uint8_t byte, uint64_t arrival);
+
+size_t HardwareSerial::write(uint8_t byte)
+{
+  //the core blocks while its buffer is full
+  if (simTxDrained > simNow + SERIAL_BUFFER * BYTE_NS)
+  {
+    uint64_t wait = simTxDrained - simNow - SERIAL_BUFFER * BYTE_NS;
+    simStats.txBlockedNs += wait;
+    simAdvance(wait);
+  }
+  simTxDrained = std::max(simTxDrained, simNow) + BYTE_NS;
+  simStats.txBytes++;
+  simHostReceive(byte, simTxDrained);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+//the PC side
+struct SimMessage {
+  uint64_t t; //arrival
+  ProtoMessage msg;
+};
+
+ProtoDecoder simDecoder;
+std::deque<SimMessage> simInbox;
+int simHostState = 0;
+int simLastBuzz = -1;
+
+//the game command in flight
+uint8_t simSeq = 0;
+uint8_t simCmdOpcode = 0;
+uint64_t simCmdSentAt = 0;
+bool simCmdAcked = true;
+int simAckBefore = -1; //the state the command found, from its ack
+
+const char* simStateName(int state)
+{
+  static const char* names[] = {"?", "idle", "accepting", "answering", "testing"};
+  return state >= 0 && state <= STATE_TESTING ? names[state] : "?";
+}
+
+void simHostReceive(uint8_t byte, uint64_t arrival)
+{
+  const ProtoMessage* decoded = protoFeed(&simDecoder, byte);
+  if (!decoded)
+  {
+    return;
+  }
+  ProtoMessage msg = *decoded;
+  if (msg.opcode == MSG_STATE || msg.opcode == MSG_HEARTBEAT)
+  {
+    simHostState = msg.payload[0];
+  }
+  if (msg.opcode == MSG_HEARTBEAT)
+  {
+    if (simStats.heartbeats++)
+    {
+      simStats.heartbeatGapMaxNs = std::max(simStats.heartbeatGapMaxNs, arrival - simStats.lastHeartbeat);
+    }
+    simStats.lastHeartbeat = arrival;
+  }
+  if (msg.opcode == MSG_BUZZ)
+  {
+    simLastBuzz = msg.payload[0];
+  }
+  if (msg.opcode == MSG_ACK && msg.payload[0] == simSeq && msg.payload[1] == simCmdOpcode)
+  {
+    if (simCmdAcked)
+    {
+      simStats.repeatAcks++;
+    }
+    else
+    {
+      simCmdAcked = true;
+      simAckBefore = msg.payload[3];
+      simStats.acks++;
+      simStats.ackTotalNs += arrival - simCmdSentAt;
+      simStats.ackMaxNs = std::max(simStats.ackMaxNs, arrival - simCmdSentAt);
+    }
+  }
+  if (simVerbose && msg.opcode != MSG_HEARTBEAT)
+  {
+    printf("[%12.3f ms] ", arrival / 1e6);
+    switch (msg.opcode)
+    {
+      case MSG_STATE:
+        printf("state %s\n", simStateName(msg.payload[0]));
+        break;
+      case MSG_ACK:
+        printf("ack %u for %02X, %s -> %s\n", msg.payload[0], msg.payload[1], simStateName(msg.payload[3]), simStateName(msg.payload[2]));
+        break;
+      case MSG_BUZZ:
+        printf("buzz player %d, %u us after opening\n", msg.payload[0] + 1, protoGetU32(&msg.payload[1]));
+        break;
+      case MSG_PRESSES:
+        printf("round:");
+        for (int i = 0; i < msg.payload[0]; i++)
+        {
+          const uint8_t* entry = &msg.payload[1 + i*6];
+          printf(" player %d flags %X %u us,", entry[0] + 1, entry[1], protoGetU32(&entry[2]));
+        }
+        printf("\n");
+        break;
+      default:
+        printf("opcode %02X\n", msg.opcode);
+    }
+  }
+  simInbox.push_back({arrival, msg});
+}
+
+void simSendFrame(uint8_t opcode, const uint8_t* payload, uint8_t len)
+{
+  uint8_t frame[PROTO_MAX_FRAME];
+  uint8_t n = protoEncode(opcode, payload, len, frame);
+  simRxLineFree = std::max(simRxLineFree, simNow);
+  for (uint8_t i = 0; i < n; i++)
+  {
+    simRxLineFree += BYTE_NS;
+    simRxLine.push_back({simRxLineFree, frame[i]});
+  }
+}
+
+//game commands get the next seq, like the PC sends them
+void simSend(uint8_t opcode)
+{
+  if (opcode < CMD_ACCEPT || opcode > CMD_WRONG)
+  {
+    simSendFrame(opcode, NULL, 0);
+    return;
+  }
+  if (!simCmdAcked)
+  {
+    simStats.unacked++;
+  }
+  simSeq = simSeq == 255 ? 1 : simSeq + 1;
+  simCmdOpcode = opcode;
+  simCmdSentAt = std::max(simRxLineFree, simNow);
+  simCmdAcked = false;
+  simSendFrame(opcode, &simSeq, 1);
+}
+
+//the last game command again with the same seq, as if its ack got lost, it must be acked but not run again
+void simRepeat()
+{
+  simStats.repeats++;
+  simSendFrame(simCmdOpcode, &simSeq, 1);
+}
+
+//one pass through loop()
+void simStep()
+{
+  uint64_t activity = simStats.txBytes + simStats.rxBytes + simStats.laneEdges + simStats.statusEdges + simStats.isrs;
+  uint64_t start = simNow;
+  loop();
+  simAdvance(LOOP_NS);
+  uint64_t took = simNow - start;
+  simStats.loops++;
+  simStats.loopNs += took;
+  simStats.loopMaxNs = std::max(simStats.loopMaxNs, took);
+
+  //nothing happened, jump ahead to whatever comes next (tasks are millis() based so 1ms steps keep them on time)
+  if (simSkipIdle && activity == simStats.txBytes + simStats.rxBytes + simStats.laneEdges + simStats.statusEdges + simStats.isrs)
+  {
+    uint64_t next = simNow + IDLE_SKIP_NS;
+    if (!simEvents.empty())
+    {
+      next = std::min(next, simEvents.top().t);
+    }
+    if (!simRxLine.empty())
+    {
+      next = std::min(next, simRxLine.front().first);
+    }
+    if (next > simNow)
+    {
+      simStats.skippedNs += next - simNow;
+      simAdvance(next - simNow);
+    }
+  }
+}
+
+void simRunUntil(uint64_t t)
+{
+  while (simNow < t)
+  {
+    simStep();
+  }
+}
+
+//runs until cond() holds, false if it didn't before the deadline
+bool simWaitFor(uint64_t deadline, const std::function<bool()>& cond)
+{
+  while (!cond())
+  {
+    if (simNow >= deadline)
+    {
+      return false;
+    }
+    simStep();
+  }
+  return true;
+}
+
+//next message with this opcode from the inbox, dropping the ones before it
+bool simTakeMessage(uint8_t opcode, uint64_t deadline, SimMessage& out)
+{
+  return simWaitFor(deadline, [&]() {
+    while (!simInbox.empty())
+    {
+      SimMessage m = simInbox.front();
+      simInbox.pop_front();
+      if (m.msg.opcode == opcode)
+      {
+        out = m;
+        return true;
+      }
+    }
+    return false;
+  });
+}
+
+int simFailures = 0;
+
+bool simCheck(bool ok, int round, const char* what)
+{
+  if (!ok)
+  {
+    printf("round %d: %s (at %.3f ms)\n", round, what, simNow / 1e6);
+    simFailures++;
+  }
+  return ok;
+}
+
+//waits until the strip of a player goes dark and records how long it took from the command
+bool simExpectDark(int round, int player, uint64_t from, uint64_t budget)
+{
+  bool dark = simWaitFor(from + budget, [&]() { return simLanes[player].lit == 0 && simLanes[player].frameAt > from; });
+  if (dark)
+  {
+    uint64_t took = simLanes[player].frameAt - from;
+    simStats.darkCount++;
+    simStats.darkTotalNs += took;
+    simStats.darkMaxNs = std::max(simStats.darkMaxNs, took);
+  }
+  return simCheck(dark, round, "strip didn't go dark in time");
+}
+
+//one random round: some players jump the gun, some press, the winner has to be the earliest eligible press
+bool simRound(std::mt19937& rng, int round)
+{
+  auto randMs = [&](double lo, double hi) { return (uint64_t)(std::uniform_real_distribution<double>(lo, hi)(rng) * MS); };
+  auto chance = [&](double p) { return std::uniform_real_distribution<double>(0, 1)(rng) < p; };
+
+  simInbox.clear();
+  simRunUntil(simNow + randMs(5, 50));
+
+  uint8_t held = 0;
+  for (int p = 0; p < 5; p++)
+  {
+    if (chance(0.1))
+    {
+      held |= _BV(p);
+      simSchedule(simNow + MS, p, true);
+    }
+  }
+  simRunUntil(simNow + 5 * MS);
+
+  uint64_t accept = simNow;
+  simSend(CMD_ACCEPT);
+  if (chance(0.2))
+  {
+    simRepeat();
+  }
+  uint64_t open = accept + 3 * MS; //well after the frame is in and handled
+
+  //held buttons let go and press again inside the lockout, that must not count
+  std::vector<uint64_t> pressAt(5, 0);
+  for (int p = 0; p < 5; p++)
+  {
+    if (held & _BV(p))
+    {
+      uint64_t release = open + randMs(20, 200);
+      simSchedule(release, p, false);
+      if (chance(0.5))
+      {
+        uint64_t again = release + randMs(20, 300);
+        simSchedule(again, p, true);
+        simSchedule(again + randMs(30, 100), p, false);
+      }
+    }
+    else if (chance(0.6))
+    {
+      pressAt[p] = open + randMs(0, 400) + p * 1000; //distinct times
+      simSchedule(pressAt[p], p, true);
+      simSchedule(pressAt[p] + randMs(30, 150), p, false);
+    }
+  }
+
+  int winner = -1;
+  for (int p = 0; p < 5; p++)
+  {
+    if (pressAt[p] && (winner < 0 || pressAt[p] < pressAt[winner]))
+    {
+      winner = p;
+    }
+  }
+
+  SimMessage m;
+  if (winner < 0)
+  {
+    //nobody buzzed, the operator stops it
+    simRunUntil(open + 1200 * MS);
+    simSend(CMD_STOP);
+    if (!simCheck(simTakeMessage(MSG_PRESSES, simNow + 50 * MS, m), round, "no round report after stop"))
+    {
+      return false;
+    }
+    simCheck(m.msg.payload[0] == __builtin_popcount(held), round, "round report should only have the held players");
+  }
+  else
+  {
+    if (!simCheck(simTakeMessage(MSG_BUZZ, pressAt[winner] + 5 * MS, m), round, "no buzz"))
+    {
+      return false;
+    }
+    uint64_t buzzAt = m.t;
+    char what[96];
+    snprintf(what, sizeof(what), "buzz went to player %d instead of %d", m.msg.payload[0] + 1, winner + 1);
+    if (!simCheck(m.msg.payload[0] == winner, round, what))
+    {
+      return false;
+    }
+    uint32_t pressMicros = protoGetU32(&m.msg.payload[5]);
+    uint32_t openMicros = pressMicros - protoGetU32(&m.msg.payload[1]);
+    int32_t off = pressMicros - (uint32_t)(pressAt[winner] / 1000); //32 bits on the wire
+    simCheck(off <= 4 && off >= -4, round, "buzz timestamp is off");
+
+    simCheck(simWaitFor(buzzAt + (FRAME_MS + 10) * MS, [&]() { return simLanes[winner].frameAt > pressAt[winner] && simLanes[winner].lit >= LIT_LEDS - 2 && simStatus.lit == STATUS_LEDS/2; }),
+             round, "winner strip didn't light up within a frame"); //the first countdown step can make it into the first frame
+
+    int wrongPlayer = -1;
+    bool winnerKnown = true; //PRESS_WINNER goes on the last player that had the floor
+    double ending = std::uniform_real_distribution<double>(0, 1)(rng);
+    if (ending < 0.6)
+    {
+      simRunUntil(simNow + randMs(10, 300));
+      uint64_t cancel = simNow;
+      simSend(CMD_CANCEL);
+      simExpectDark(round, winner, cancel, (FRAME_MS + 10) * MS);
+    }
+    else if (ending < 0.85)
+    {
+      //wrong answer, the floor goes to the earliest press so far or answers open again
+      simRunUntil(simNow + randMs(10, 300));
+      uint64_t handled = simNow + 10 * BYTE_NS; //the frame is in and handled by then
+      wrongPlayer = winner;
+      int next = -1;
+      bool ambiguous = false;
+      for (int p = 0; p < 5; p++)
+      {
+        if (p != winner && pressAt[p])
+        {
+          if (pressAt[p] + MS / 2 > simNow && pressAt[p] < handled + MS / 2)
+          {
+            ambiguous = true;
+          }
+          else if (pressAt[p] < simNow && (next < 0 || pressAt[p] < pressAt[next]))
+          {
+            next = p;
+          }
+        }
+      }
+      simInbox.clear();
+      winnerKnown = false; //answers may open again and someone else take the floor
+      simSend(CMD_WRONG);
+      if (chance(0.3))
+      {
+        simRepeat(); //running it twice would skip the player after next
+      }
+      if (next >= 0 && !ambiguous)
+      {
+        if (!simCheck(simTakeMessage(MSG_BUZZ, simNow + 5 * MS, m), round, "no handover after wrong") ||
+            !simCheck(m.msg.payload[0] == next, round, "handover went to the wrong player"))
+        {
+          return false;
+        }
+        simExpectDark(round, winner, handled, (FRAME_MS + 10) * MS);
+        winner = next;
+        winnerKnown = true;
+      }
+      else if (!ambiguous)
+      {
+        simCheck(simWaitFor(simNow + 5 * MS, [&]() { return simHostState == STATE_ACCEPTING || simHostState == STATE_ANSWERING; }), round, "answers didn't reopen after wrong");
+      }
+      simRunUntil(simNow + randMs(10, 100));
+      simSend(simHostState == STATE_ACCEPTING ? CMD_STOP : CMD_CANCEL);
+    }
+    else
+    {
+      //the countdown runs out on its own
+      simCheck(simWaitFor(buzzAt + (COUNTDOWN_STEPS * COUNTDOWN_MS + 2*FRAME_MS) * MS, [&]() { return simLanes[winner].lit == 0; }), round, "countdown didn't finish on time");
+      simCheck(simNow > buzzAt + ((COUNTDOWN_STEPS - 1) * COUNTDOWN_MS) * MS, round, "countdown finished early");
+    }
+
+    if (!simCheck(simTakeMessage(MSG_PRESSES, simNow + 7000 * MS, m), round, "no round report"))
+    {
+      return false;
+    }
+    uint64_t closed = m.t - (m.msg.len + 4) * BYTE_NS; //when it went out
+    for (int p = 0; p < 5; p++)
+    {
+      const uint8_t* entry = NULL;
+      for (int i = 0; i < m.msg.payload[0]; i++)
+      {
+        if (m.msg.payload[1 + i*6] == p)
+        {
+          entry = &m.msg.payload[1 + i*6];
+        }
+      }
+      if (held & _BV(p))
+      {
+        simCheck(entry && (entry[1] & PRESS_EARLY), round, "held player not flagged early");
+      }
+      if (pressAt[p] && pressAt[p] + MS < closed)
+      {
+        simCheck(entry && (entry[1] & PRESS_TIMED), round, "press missing from the round report");
+        if (entry)
+        {
+          int32_t off = protoGetU32(&entry[2]) - ((uint32_t)(pressAt[p] / 1000) - openMicros);
+          simCheck(off <= 4 && off >= -4, round, "press time in the round report is off");
+        }
+      }
+      if (winnerKnown)
+      {
+        simCheck((entry && (entry[1] & PRESS_WINNER)) == (p == winner), round, "winner flag isn't on the last player that had the floor");
+      }
+      if (p == wrongPlayer)
+      {
+        simCheck(entry && (entry[1] & PRESS_WRONG), round, "wrong player not flagged");
+      }
+      else if (entry)
+      {
+        simCheck(!(entry[1] & PRESS_WRONG), round, "player flagged wrong who wasn't"); //a repeated wrong ran twice
+      }
+    }
+  }
+
+  //let go of everything and settle back to idle
+  for (int p = 0; p < 5; p++)
+  {
+    simSchedule(simNow, p, false);
+  }
+  simRunUntil(simNow + 2000 * MS);
+  while (!simEvents.empty())
+  {
+    simRunUntil(simEvents.top().t + MS);
+  }
+  simRunUntil(simNow + 50 * MS);
+  simLastBuzz = -1;
+  return simCheck(simHostState == STATE_IDLE, round, "not idle after the round");
+}
+
+//a host that restarts can start on the seq the controller saw last, that mustn't make its first command a repeat
+bool simRestart(int round)
+{
+  //the same seq with another opcode is a new command
+  simSeq = simSeq == 1 ? 255 : simSeq - 1;
+  simSend(CMD_TEST);
+  if (!simCheck(simWaitFor(simNow + 100 * MS, []() { return simHostState == STATE_TESTING; }), round, "a new command with the last seq didn't run"))
+  {
+    return false;
+  }
+  simSend(CMD_STOP);
+  simCheck(simWaitFor(simNow + 100 * MS, []() { return simHostState == STATE_IDLE; }), round, "not idle after stop");
+  simCheck(simCmdAcked && simAckBefore == STATE_TESTING, round, "the ack of stop didn't say it found test mode");
+
+  //and the identify a host sends on every open makes the controller forget the last one
+  simSend(CMD_IDENTIFY);
+  simRunUntil(simNow + 5 * MS);
+  simCheck(cmdSeq == 0 && cmdOpcode == 0, round, "identify didn't reset the seq");
+  simSeq = simSeq == 1 ? 255 : simSeq - 1;
+  simSend(CMD_STOP);
+  simRunUntil(simNow + 5 * MS);
+  simCheck(simCmdAcked && cmdSeq == simSeq && cmdOpcode == CMD_STOP, round, "the first command after identify was taken for a repeat");
+  simCheck(simAckBefore == STATE_IDLE, round, "the ack of a stop that did nothing didn't say so");
+  return true;
+}
+
+int simScript(const char* path)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    printf("can't open %s\n", path);
+    return 1;
+  }
+  uint64_t base = simNow;
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line))
+  {
+    lineNumber++;
+    std::istringstream in(line);
+    double ms;
+    std::string what;
+    if (line.empty() || line[0] == '#' || !(in >> ms >> what))
+    {
+      continue;
+    }
+    simRunUntil(base + (uint64_t)(ms * MS));
+    if (what == "accept") simSend(CMD_ACCEPT);
+    else if (what == "stop") simSend(CMD_STOP);
+    else if (what == "cancel") simSend(CMD_CANCEL);
+    else if (what == "wrong") simSend(CMD_WRONG);
+    else if (what == "test") simSend(CMD_TEST);
+    else if (what == "press" || what == "release")
+    {
+      int player;
+      in >> player;
+      simSchedule(simNow, player - 1, what == "press");
+    }
+    else if (what == "expect")
+    {
+      std::string kind, value;
+      in >> kind >> value;
+      bool ok = kind == "buzz" ? simLastBuzz + 1 == atoi(value.c_str()) : value == simStateName(simHostState);
+      simCheck(ok, lineNumber, line.c_str());
+    }
+    else
+    {
+      printf("line %d: don't know \"%s\"\n", lineNumber, what.c_str());
+    }
+  }
+  simRunUntil(simNow + 100 * MS);
+  return simFailures ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+  int rounds = 1000;
+  unsigned seed = 1;
+  const char* script = NULL;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--rounds" && i + 1 < argc) rounds = atoi(argv[++i]);
+    else if (arg == "--seed" && i + 1 < argc) seed = atoi(argv[++i]);
+    else if (arg == "--script" && i + 1 < argc) script = argv[++i];
+    else if (arg == "--verbose") simVerbose = true;
+    else
+    {
+      printf("usage: %s [--rounds N] [--seed N] [--script file] [--verbose]\n", argv[0]);
+      return 1;
+    }
+  }
+  protoReset(&simDecoder);
+  auto realStart = std::chrono::steady_clock::now();
+
+  //the host looks for the controller while it's still in its boot delay
+  simRxLineFree = 1000 * MS;
+  simSend(CMD_IDENTIFY);
+
+  //boot and let the startup sequence run through, then out of test mode
+  setup();
+  SimMessage identity;
+  if (!simTakeMessage(MSG_IDENTITY, simNow, identity) || identity.msg.len < 5 ||
+      memcmp(identity.msg.payload, PROTO_SIGNATURE, 4) || identity.msg.payload[4] != PROTO_VERSION)
+  {
+    printf("no identity during the boot delay\n");
+    return 1;
+  }
+  if (!simWaitFor(simNow + 20000 * MS, []() { return simLed13 && !tasks[TASK_STARTUP].active; }))
+  {
+    printf("startup sequence didn't finish\n");
+    return 1;
+  }
+  printf("startup sequence took %.0f ms\n", simNow / 1e6);
+  simSend(CMD_STOP);
+  if (!simWaitFor(simNow + 100 * MS, []() { return simHostState == STATE_IDLE; }))
+  {
+    printf("not idle after stop\n");
+    return 1;
+  }
+
+  int played = 0;
+  uint64_t simStart = simNow;
+  if (script)
+  {
+    simScript(script);
+  }
+  else
+  {
+    std::mt19937 rng(seed);
+    for (played = 0; played < rounds && !simFailures; played++)
+    {
+      simRound(rng, played + 1);
+    }
+    if (!simFailures)
+    {
+      simRestart(played + 1);
+    }
+  }
+
+  double real = std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+  double simulated = (simNow - simStart) / 1e9;
+  if (!script)
+  {
+    printf("rounds: %d (seed %u), %d failed checks, %.2f s real, %.0f rounds/s, %.1f s simulated\n", played, seed, simFailures, real, played / real, simulated);
+  }
+  printf("loop(): %llu passes, avg %.1f us, max %.2f ms (%.1f s skipped while idle)\n", (unsigned long long)simStats.loops,
+         simStats.loopNs / 1e3 / simStats.loops, simStats.loopMaxNs / 1e6, simStats.skippedNs / 1e9);
+  if (simLanes[0].frames)
+  {
+    printf("player strips: %llu frames, %.2f ms per show (%llu clock edges)\n", (unsigned long long)simLanes[0].frames,
+           simStats.laneEdges * EDGE_NS / 1e6 / simLanes[0].frames, (unsigned long long)(simStats.laneEdges / simLanes[0].frames));
+  }
+  if (simStatus.frames)
+  {
+    printf("status strip: %llu frames, %.2f ms per show\n", (unsigned long long)simStatus.frames, simStats.statusEdges * EDGE_NS / 1e6 / simStatus.frames);
+  }
+  printf("serial: %llu bytes out, %llu bytes in, %llu rx overflows, tx blocked %.2f ms\n", (unsigned long long)simStats.txBytes,
+         (unsigned long long)simStats.rxBytes, (unsigned long long)simStats.rxOverflows, simStats.txBlockedNs / 1e6);
+  printf("heartbeats: %llu, longest gap %.1f ms\n", (unsigned long long)simStats.heartbeats, simStats.heartbeatGapMaxNs / 1e6);
+  if (simStats.darkCount)
+  {
+    printf("command to dark strip: avg %.1f ms, max %.1f ms\n", simStats.darkTotalNs / 1e6 / simStats.darkCount, simStats.darkMaxNs / 1e6);
+  }
+  if (simStats.acks)
+  {
+    printf("command to ack: %llu acks, avg %.1f us, max %.1f us, %llu of %llu repeats acked, %llu never acked\n", (unsigned long long)simStats.acks,
+           simStats.ackTotalNs / 1e3 / simStats.acks, simStats.ackMaxNs / 1e3, (unsigned long long)simStats.repeatAcks,
+           (unsigned long long)simStats.repeats, (unsigned long long)simStats.unacked);
+  }
+  if (simStats.unacked || !simCmdAcked || simStats.repeatAcks != simStats.repeats)
+  {
+    simFailures++;
+  }
+  return simFailures ? 1 : 0;
+}
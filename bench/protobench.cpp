@@ -0,0 +1,163 @@
+/*
+ * Serial protocol parser microbenchmark
+ *
+ * Encodes a few million random frames into one stream, like a very busy controller would send them, then parses
+ * it with protoParse() in reads of different sizes (reads split frames anywhere, like the port does) and with
+ * protoFeed() a byte at a time. Prints the cost per byte and per message and checks that every frame came out.
+ * A few corrupted frames are mixed in, they must be dropped without taking their neighbours with them.
+ * The times include folding every message into a checksum, which is how the frames are checked.
+ *
+ *   make bench
+ *   bin/linux/protobench [megabytes]
+ */
+#include "../arduino/jeopardy/protocol.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+struct Stream {
+	std::vector<uint8_t> bytes;
+	size_t frames = 0; //good ones
+	size_t corrupted = 0;
+	uint64_t checksum = 0; //over the opcodes and payloads of the good frames
+};
+
+uint64_t mix(uint64_t sum, const ProtoMessage* msg)
+{
+	sum = sum * 31 + msg->opcode;
+	for (uint8_t i = 0; i < msg->len; i++)
+	{
+		sum = sum * 31 + msg->payload[i];
+	}
+	return sum * 31 + msg->len;
+}
+
+Stream makeStream(size_t size, unsigned seed)
+{
+	Stream s;
+	std::mt19937 rng(seed);
+	uint8_t frame[PROTO_MAX_FRAME];
+	ProtoMessage msg;
+	while (s.bytes.size() < size)
+	{
+		//mostly heartbeats and pongs, now and then a full round report, zeros are common in payloads
+		msg.opcode = 1 + rng() % 5;
+		int kind = rng() % 10;
+		msg.len = kind < 6 ? 1 : (kind < 9 ? 8 : 1 + 5*6);
+		for (uint8_t i = 0; i < msg.len; i++)
+		{
+			msg.payload[i] = rng() % 3 == 0 ? 0 : rng();
+		}
+		uint8_t n = protoEncode(msg.opcode, msg.payload, msg.len, frame);
+		//line noise, one flipped bit in a data byte (not a cobs code byte, and not into a delimiter)
+		//crc-8 catches every single bit error, so these have to be dropped every time
+		size_t victim = 1 + rng() % (n - 2);
+		for (size_t code = 0; code < victim; code += frame[code])
+		{
+			if (code + frame[code] == victim)
+			{
+				victim = 0;
+				break;
+			}
+		}
+		uint8_t flipped = victim ? frame[victim] ^ (1 << (rng() % 8)) : 0;
+		if (rng() % 1000 == 0 && flipped)
+		{
+			frame[victim] = flipped;
+			s.corrupted++;
+		}
+		else
+		{
+			s.frames++;
+			s.checksum = mix(s.checksum, &msg);
+		}
+		s.bytes.insert(s.bytes.end(), frame, frame + n);
+	}
+	return s;
+}
+
+struct Result {
+	size_t frames = 0;
+	uint64_t checksum = 0;
+	double seconds = 0;
+};
+
+Result parseChunks(const Stream& s, size_t chunk)
+{
+	Result r;
+	ProtoDecoder decoder{};
+	protoReset(&decoder);
+	auto start = std::chrono::steady_clock::now();
+	for (size_t pos = 0; pos < s.bytes.size(); pos += chunk)
+	{
+		const uint8_t* data = s.bytes.data() + pos;
+		uint16_t left = std::min(chunk, s.bytes.size() - pos);
+		while (left)
+		{
+			uint16_t used;
+			const ProtoMessage* msg = protoParse(&decoder, data, left, &used);
+			data += used;
+			left -= used;
+			if (msg)
+			{
+				r.frames++;
+				r.checksum = mix(r.checksum, msg);
+			}
+		}
+	}
+	r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return r;
+}
+
+Result parseBytes(const Stream& s)
+{
+	Result r;
+	ProtoDecoder decoder{};
+	protoReset(&decoder);
+	auto start = std::chrono::steady_clock::now();
+	for (uint8_t b : s.bytes)
+	{
+		const ProtoMessage* msg = protoFeed(&decoder, b);
+		if (msg)
+		{
+			r.frames++;
+			r.checksum = mix(r.checksum, msg);
+		}
+	}
+	r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return r;
+}
+
+bool report(const char* name, const Stream& s, const Result& r)
+{
+	bool ok = r.frames == s.frames && r.checksum == s.checksum;
+	printf("%-22s %6.2f ns/byte %7.1f ns/message %8.1f MB/s  %s\n", name, r.seconds * 1e9 / s.bytes.size(),
+	       r.seconds * 1e9 / r.frames, s.bytes.size() / r.seconds / 1e6, ok ? "ok" : "MISMATCH");
+	if (!ok)
+	{
+		printf("  %zu of %zu frames\n", r.frames, s.frames);
+	}
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	size_t megabytes = argc > 1 ? atoi(argv[1]) : 64;
+	Stream s = makeStream(megabytes << 20, 1);
+	printf("%zu bytes, %zu good frames, %zu corrupted\n", s.bytes.size(), s.frames, s.corrupted);
+
+	bool ok = true;
+	ok &= report("protoFeed per byte", s, parseBytes(s));
+	static const size_t chunks[] = {1, 7, 64, 255, 4096};
+	for (size_t chunk : chunks)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "protoParse %zu byte reads", chunk);
+		ok &= report(name, s, parseChunks(s, chunk));
+	}
+	return ok ? 0 : 1;
+}
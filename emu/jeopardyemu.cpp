@@ -0,0 +1,598 @@
+/*
+ * Jeopardy controller emulator
+ *
+ * Plays the controller on a pseudo-terminal, so the PC side can be run and stressed with nothing plugged in.
+ * It answers identify requests like the firmware, so JpController's probe finds it, and it speaks protocol.h the
+ * way jeopardy.ino does: acked game commands, pings, heartbeats, buzzes, handovers and round reports.
+ * Players press at random at a given rate or on a script, far faster than five people can if asked to, and the
+ * output can be corrupted and chopped up to give the parser something to chew on.
+ *
+ *   make emu
+ *   bin/linux/jeopardyemu [--presses N] [--flood N] [--garbage P] [--fragment] [--script file] [--seed N]
+ *                         [--link path] [--verbose]
+ *   bin/linux/JpController /dev/pts/N    (the path it prints, or the --link path)
+ *
+ *   --presses N   random presses per second while a round is open (default 3)
+ *   --flood N     extra heartbeats and round reports per second on top, in any state
+ *   --garbage P   fraction of frames that get a flipped bit, lose their end or have junk in front of them
+ *   --fragment    write frames a few bytes at a time with short gaps, and several frames in one write
+ *   --script file replaces the random presses, lines are "<ms> press <player>" or "<ms> junk <bytes>",
+ *                 time 0 is when answers open and the script starts over every round
+ *   --link path   symlink to the pty, run as root with /dev/ttyUSB9 and the PC treats it like a plugged in board
+ *
+ * Ctrl-C prints what was sent and received.
+ */
+#include "../arduino/jeopardy/protocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define ANSWER_MS 6150 //the firmware's countdown, 41 steps of 150ms
+
+struct EmuStats {
+	uint64_t frames = 0;
+	uint64_t bytes = 0;
+	uint64_t corrupted = 0;
+	uint64_t dropped = 0; //bytes the pty wouldn't take, nobody is reading
+	uint64_t commands = 0;
+	uint64_t repeats = 0;
+	uint64_t identifies = 0;
+	uint64_t pings = 0;
+	uint64_t rounds = 0;
+	uint64_t buzzes = 0;
+} emuStats;
+
+struct EmuPress {
+	int player;
+	uint8_t flags;
+	uint32_t delta;
+};
+
+struct EmuScriptLine {
+	uint64_t at; //micros after answers open
+	bool press;
+	int value; //player or junk bytes
+};
+
+int emuFd = -1;
+std::mt19937 emuRng;
+bool emuVerbose = false;
+bool emuFragment = false;
+double emuGarbage = 0;
+std::vector<uint8_t> emuOut;
+volatile sig_atomic_t emuRunning = 1;
+std::string emuLink;
+
+//the controller
+uint8_t emuState = STATE_IDLE;
+uint8_t emuSeq = 0;
+uint8_t emuSeqOpcode = 0; //a repeat matches both, like the firmware's cmdSeq and cmdOpcode
+uint8_t emuStateBefore = 0; //what the last command found, acked with it
+bool emuRoundOpen = false;
+uint32_t emuOpenTime = 0;
+std::vector<EmuPress> emuPresses; //first press of every player this round, in order
+int emuAnswering = -1; //index into emuPresses
+int emuWinner = -1; //the last press that had the floor, gets PRESS_WINNER like the firmware's roundWinner
+uint64_t emuAnswerEnd = 0;
+
+//micros() is the PC's own monotonic clock (JpController's hostMicros()), so press times can be checked exactly
+uint64_t emuMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double emuUniform()
+{
+	return std::uniform_real_distribution<double>(0, 1)(emuRng);
+}
+
+//gap until the next of a poisson process with this rate per second
+uint64_t emuGap(double rate)
+{
+	return rate > 0 ? (uint64_t)(std::exponential_distribution<double>(rate)(emuRng) * 1e6) + 1 : UINT64_MAX / 2;
+}
+
+//some frames get broken on the way, the host has to drop them without losing the ones around them
+void emuSend(uint8_t opcode, const uint8_t* payload, uint8_t len)
+{
+	uint8_t frame[PROTO_MAX_FRAME];
+	uint8_t n = protoEncode(opcode, payload, len, frame);
+	if (emuGarbage > 0 && emuUniform() < emuGarbage)
+	{
+		emuStats.corrupted++;
+		switch (emuRng() % 3)
+		{
+			case 0:
+				frame[1 + emuRng() % (n - 2)] ^= 1 << (emuRng() % 8);
+				break;
+			case 1:
+				n = 1 + emuRng() % (n - 1); //the next frame runs into what's left of it
+				break;
+			case 2:
+				for (int i = emuRng() % 16; i > 0; i--)
+				{
+					emuOut.push_back(emuRng());
+				}
+				break;
+		}
+	}
+	else
+	{
+		emuStats.frames++;
+	}
+	emuOut.insert(emuOut.end(), frame, frame + n);
+}
+
+void emuWrite(const uint8_t* data, size_t len)
+{
+	ssize_t n = ::write(emuFd, data, len);
+	n = std::max<ssize_t>(n, 0);
+	emuStats.bytes += n;
+	emuStats.dropped += len - n;
+}
+
+//everything queued goes out, in one write or chopped into bits with gaps so the host's reads split frames
+void emuFlush()
+{
+	if (!emuFragment)
+	{
+		emuWrite(emuOut.data(), emuOut.size());
+	}
+	else
+	{
+		//a gap after every fourth write or so is enough for the host to read in between, more would cap the rate
+		for (size_t i = 0; i < emuOut.size();)
+		{
+			size_t chunk = std::min<size_t>(1 + emuRng() % 7, emuOut.size() - i);
+			emuWrite(emuOut.data() + i, chunk);
+			i += chunk;
+			if (emuRng() % 4 == 0)
+			{
+				usleep(20 + emuRng() % 80);
+			}
+		}
+	}
+	emuOut.clear();
+}
+
+void emuSetState(uint8_t state)
+{
+	if (state != emuState)
+	{
+		emuState = state;
+		emuSend(MSG_STATE, &state, 1);
+		if (emuVerbose)
+		{
+			printf("[%10.3f ms] state %d\n", emuMicros() / 1e3, state);
+		}
+	}
+}
+
+void emuBuzz(int index)
+{
+	const EmuPress& press = emuPresses[index];
+	uint8_t payload[9];
+	payload[0] = press.player;
+	protoPutU32(payload + 1, press.delta);
+	protoPutU32(payload + 5, emuOpenTime + press.delta);
+	emuSend(MSG_BUZZ, payload, 9);
+	emuAnswering = index;
+	emuWinner = index;
+	emuAnswerEnd = emuMicros() + ANSWER_MS * 1000ull;
+	emuStats.buzzes++;
+	emuSetState(STATE_ANSWERING);
+	if (emuVerbose)
+	{
+		printf("[%10.3f ms] buzz player %d, %u us\n", emuMicros() / 1e3, press.player + 1, press.delta);
+	}
+}
+
+void emuReport(const std::vector<EmuPress>& presses)
+{
+	uint8_t payload[1 + 5*6];
+	payload[0] = presses.size();
+	for (size_t i = 0; i < presses.size(); i++)
+	{
+		payload[1 + i*6] = presses[i].player;
+		payload[2 + i*6] = presses[i].flags;
+		protoPutU32(payload + 3 + i*6, presses[i].delta);
+	}
+	emuSend(MSG_PRESSES, payload, 1 + presses.size() * 6);
+}
+
+void emuCloseRound()
+{
+	if (!emuRoundOpen)
+	{
+		return;
+	}
+	emuRoundOpen = false;
+	if (emuWinner >= 0)
+	{
+		emuPresses[emuWinner].flags |= PRESS_WINNER;
+	}
+	emuAnswering = -1;
+	emuReport(emuPresses);
+	emuStats.rounds++;
+}
+
+//like the firmware's nextInQueue(), the earliest press that hasn't had the floor yet
+int emuNextInQueue()
+{
+	for (size_t i = 0; i < emuPresses.size(); i++)
+	{
+		if (!(emuPresses[i].flags & PRESS_WRONG) && (int)i != emuAnswering)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+void emuPress(int player)
+{
+	if (!emuRoundOpen || player < 0 || player >= 5)
+	{
+		return;
+	}
+	for (const EmuPress& press : emuPresses)
+	{
+		if (press.player == player)
+		{
+			return; //only the first press of a round counts
+		}
+	}
+	emuPresses.push_back({player, PRESS_TIMED, (uint32_t)emuMicros() - emuOpenTime});
+	if (emuState == STATE_ACCEPTING)
+	{
+		emuBuzz(emuPresses.size() - 1);
+	}
+}
+
+//loop() with the command it read, acked with the state it led to
+void emuCommand(uint8_t opcode)
+{
+	switch (emuState)
+	{
+		case STATE_ANSWERING:
+			if (opcode == CMD_CANCEL || opcode == CMD_STOP)
+			{
+				emuCloseRound();
+				emuSetState(STATE_IDLE);
+			}
+			else if (opcode == CMD_WRONG)
+			{
+				emuPresses[emuAnswering].flags |= PRESS_WRONG;
+				int next = emuNextInQueue();
+				emuAnswering = -1;
+				if (next >= 0)
+				{
+					emuBuzz(next);
+				}
+				else
+				{
+					emuSetState(STATE_ACCEPTING);
+				}
+			}
+			break;
+		case STATE_ACCEPTING:
+		case STATE_TESTING:
+			if (opcode == CMD_STOP)
+			{
+				emuCloseRound();
+				emuSetState(STATE_IDLE);
+			}
+			break;
+		case STATE_IDLE:
+			if (opcode == CMD_ACCEPT)
+			{
+				emuRoundOpen = true;
+				emuPresses.clear();
+				emuAnswering = -1;
+				emuWinner = -1;
+				emuOpenTime = emuMicros();
+				emuSetState(STATE_ACCEPTING);
+			}
+			else if (opcode == CMD_TEST)
+			{
+				emuSetState(STATE_TESTING);
+			}
+			break;
+	}
+}
+
+void emuAck(uint8_t seq, uint8_t opcode)
+{
+	uint8_t payload[4] = {seq, opcode, emuState, emuStateBefore};
+	emuSend(MSG_ACK, payload, 4);
+}
+
+void emuReceive(const ProtoMessage* msg)
+{
+	switch (msg->opcode)
+	{
+		case CMD_IDENTIFY:
+		{
+			emuSeq = 0;
+			emuSeqOpcode = 0;
+			uint8_t payload[5];
+			memcpy(payload, PROTO_SIGNATURE, 4);
+			payload[4] = PROTO_VERSION;
+			emuSend(MSG_IDENTITY, payload, 5);
+			emuStats.identifies++;
+			break;
+		}
+		case CMD_PING:
+			if (msg->len >= 4)
+			{
+				uint8_t payload[8];
+				memcpy(payload, msg->payload, 4);
+				protoPutU32(payload + 4, emuMicros());
+				emuSend(MSG_PONG, payload, 8);
+				emuStats.pings++;
+			}
+			break;
+		case CMD_ACCEPT:
+		case CMD_STOP:
+		case CMD_CANCEL:
+		case CMD_TEST:
+		case CMD_WRONG:
+			if (msg->len < 1 || msg->payload[0] == 0)
+			{
+				break;
+			}
+			if (msg->payload[0] == emuSeq && msg->opcode == emuSeqOpcode)
+			{
+				emuStats.repeats++;
+			}
+			else
+			{
+				emuSeq = msg->payload[0];
+				emuSeqOpcode = msg->opcode;
+				emuStateBefore = emuState;
+				emuStats.commands++;
+				if (emuVerbose)
+				{
+					printf("[%10.3f ms] command %02X seq %u\n", emuMicros() / 1e3, msg->opcode, emuSeq);
+				}
+				emuCommand(msg->opcode);
+			}
+			emuAck(emuSeq, msg->opcode);
+			break;
+	}
+}
+
+//extra traffic that doesn't change anything, heartbeats and a made up round report now and then
+void emuFloodFrame()
+{
+	if (emuRng() % 4)
+	{
+		emuSend(MSG_HEARTBEAT, &emuState, 1);
+		return;
+	}
+	std::vector<EmuPress> presses;
+	for (int p = 0; p < 5; p++)
+	{
+		if (emuRng() % 2)
+		{
+			presses.push_back({p, PRESS_TIMED, (uint32_t)(emuRng() % 2000000)});
+		}
+	}
+	emuReport(presses);
+}
+
+std::vector<EmuScriptLine> emuLoadScript(const char* path)
+{
+	std::vector<EmuScriptLine> script;
+	std::ifstream file(path);
+	if (!file)
+	{
+		printf("can't open %s\n", path);
+		exit(1);
+	}
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		std::istringstream in(line);
+		double ms;
+		std::string what;
+		int value;
+		if (line.empty() || line[0] == '#' || !(in >> ms >> what))
+		{
+			continue;
+		}
+		if ((what != "press" && what != "junk") || !(in >> value))
+		{
+			printf("line %d: don't know \"%s\"\n", lineNumber, line.c_str());
+			exit(1);
+		}
+		script.push_back({(uint64_t)(ms * 1000), what == "press", what == "press" ? value - 1 : value});
+	}
+	std::stable_sort(script.begin(), script.end(), [](const EmuScriptLine& a, const EmuScriptLine& b) { return a.at < b.at; });
+	return script;
+}
+
+void emuStop(int)
+{
+	emuRunning = 0;
+}
+
+int main(int argc, char** argv)
+{
+	double pressRate = 3;
+	double floodRate = 0;
+	unsigned seed = 1;
+	const char* scriptPath = NULL;
+	bool ratesGiven = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--presses" && hasValue) { pressRate = atof(argv[++i]); ratesGiven = true; }
+		else if (arg == "--flood" && hasValue) floodRate = atof(argv[++i]);
+		else if (arg == "--garbage" && hasValue) emuGarbage = atof(argv[++i]);
+		else if (arg == "--fragment") emuFragment = true;
+		else if (arg == "--script" && hasValue) scriptPath = argv[++i];
+		else if (arg == "--seed" && hasValue) seed = atoi(argv[++i]);
+		else if (arg == "--link" && hasValue) emuLink = argv[++i];
+		else if (arg == "--verbose") emuVerbose = true;
+		else
+		{
+			printf("usage: %s [--presses N] [--flood N] [--garbage P] [--fragment] [--script file] [--seed N] [--link path] [--verbose]\n", argv[0]);
+			return 1;
+		}
+	}
+	emuRng.seed(seed);
+	std::vector<EmuScriptLine> script;
+	if (scriptPath)
+	{
+		script = emuLoadScript(scriptPath);
+		if (!ratesGiven)
+		{
+			pressRate = 0;
+		}
+	}
+
+	//the slave end stays open here too, otherwise the master hangs up every time the PC closes the port
+	int slave;
+	char name[128];
+	if (openpty(&emuFd, &slave, name, NULL, NULL) < 0)
+	{
+		perror("openpty");
+		return 1;
+	}
+	termios tty;
+	tcgetattr(slave, &tty);
+	cfmakeraw(&tty); //no echo of our own output back at us before the PC has set the port up
+	tcsetattr(slave, TCSANOW, &tty);
+	fcntl(emuFd, F_SETFL, fcntl(emuFd, F_GETFL) | O_NONBLOCK);
+	if (!emuLink.empty())
+	{
+		unlink(emuLink.c_str());
+		if (symlink(name, emuLink.c_str()) < 0)
+		{
+			perror(emuLink.c_str());
+			emuLink.clear();
+		}
+	}
+	printf("controller on %s%s%s\n", name, emuLink.empty() ? "" : ", linked from ", emuLink.c_str());
+	fflush(stdout);
+	signal(SIGINT, emuStop);
+	signal(SIGTERM, emuStop);
+
+	ProtoDecoder decoder;
+	protoReset(&decoder);
+	uint64_t now = emuMicros();
+	uint64_t nextHeartbeat = now + HEARTBEAT_MS * 1000;
+	uint64_t nextPress = now + emuGap(pressRate);
+	uint64_t nextFlood = now + emuGap(floodRate);
+	size_t scriptPos = 0;
+	while (emuRunning)
+	{
+		now = emuMicros();
+		if (now >= nextHeartbeat)
+		{
+			emuSend(MSG_HEARTBEAT, &emuState, 1);
+			nextHeartbeat += HEARTBEAT_MS * 1000;
+		}
+		if (now >= nextPress)
+		{
+			emuPress(emuRng() % 5);
+			nextPress = now + emuGap(pressRate);
+		}
+		if (nextFlood + 100000 < now)
+		{
+			nextFlood = now; //a rate the pty can't keep up with doesn't pile up
+		}
+		while (now >= nextFlood)
+		{
+			emuFloodFrame();
+			nextFlood += emuGap(floodRate);
+		}
+		if (emuRoundOpen)
+		{
+			for (; scriptPos < script.size() && emuOpenTime + script[scriptPos].at <= now; scriptPos++)
+			{
+				if (script[scriptPos].press)
+				{
+					emuPress(script[scriptPos].value);
+				}
+				else
+				{
+					for (int i = 0; i < script[scriptPos].value; i++)
+					{
+						emuOut.push_back(emuRng());
+					}
+				}
+			}
+		}
+		else
+		{
+			scriptPos = 0;
+		}
+		if (emuState == STATE_ANSWERING && now >= emuAnswerEnd)
+		{
+			emuCloseRound(); //the countdown ran out
+			emuSetState(STATE_IDLE);
+		}
+		emuFlush();
+
+		uint64_t next = std::min({nextHeartbeat, nextPress, nextFlood});
+		if (emuState == STATE_ANSWERING)
+		{
+			next = std::min(next, emuAnswerEnd);
+		}
+		if (emuRoundOpen && scriptPos < script.size())
+		{
+			next = std::min<uint64_t>(next, emuOpenTime + script[scriptPos].at);
+		}
+		pollfd pfd = {emuFd, POLLIN, 0};
+		int timeoutMs = next > now ? (int)std::min<uint64_t>((next - now + 999) / 1000, 1000) : 0;
+		if (poll(&pfd, 1, timeoutMs) > 0 && (pfd.revents & POLLIN))
+		{
+			uint8_t buf[256];
+			ssize_t n;
+			while ((n = ::read(emuFd, buf, sizeof(buf))) > 0)
+			{
+				for (ssize_t i = 0; i < n; i++)
+				{
+					const ProtoMessage* msg = protoFeed(&decoder, buf[i]);
+					if (msg)
+					{
+						emuReceive(msg);
+					}
+				}
+			}
+		}
+	}
+
+	if (!emuLink.empty())
+	{
+		unlink(emuLink.c_str());
+	}
+	printf("\nsent %llu frames (%llu corrupted), %llu bytes, %llu bytes nobody read\n", (unsigned long long)emuStats.frames,
+	       (unsigned long long)emuStats.corrupted, (unsigned long long)emuStats.bytes, (unsigned long long)emuStats.dropped);
+	printf("%llu rounds, %llu buzzes\n", (unsigned long long)emuStats.rounds, (unsigned long long)emuStats.buzzes);
+	printf("received %llu commands, %llu repeats, %llu identifies, %llu pings\n", (unsigned long long)emuStats.commands,
+	       (unsigned long long)emuStats.repeats, (unsigned long long)emuStats.identifies, (unsigned long long)emuStats.pings);
+	close(slave);
+	close(emuFd);
+	return 0;
+}
@@ -0,0 +1,459 @@
+#ifndef JEOPARDY_BOARD_HPP
+#define JEOPARDY_BOARD_HPP
+
+#include <eepp/ee.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "../arduino/jeopardy/protocol.h"
+#include "trace.hpp"
+
+//audience board, a second window (JpController --board file) with the category grid, the open question,
+//the scores and who has the floor, drawn from the same state as the operator panel in the same mainLoop() pass
+//everything goes through a BatchRenderer, the boxes in one batch and the text in one batch per font size,
+//so a full board is about five draw calls at any resolution, and it's only redrawn when what it shows changed
+#define BOARD_COLUMNS 6
+#define BOARD_ROWS 5
+#define BOARD_PLAYERS 5
+
+//a Text that hands its cached glyph geometry to a batch as triangles instead of drawing itself
+//the geometry is only redone when the string or the size changes, like a Text's
+class BoardText : public Text {
+  public:
+	void set(const String& text, unsigned int size, Float wrapWidth = 0)
+	{
+		if (text == source && size == getCharacterSize() && wrapWidth == wrappedTo)
+		{
+			return;
+		}
+		source = text;
+		wrappedTo = wrapWidth;
+		setFontSize(size);
+		setString(text);
+		if (wrapWidth > 0)
+		{
+			wrapText(wrapWidth);
+		}
+	}
+
+	//centered in rect, the batch has to have the font's texture for this size set
+	void batch(BatchRenderer* batch, const Rectf& rect, const Color& color)
+	{
+		ensureGeometryUpdate();
+		Float x = std::floor(rect.Left + (rect.getWidth() - getTextWidth()) / 2);
+		Float y = std::floor(rect.Top + (rect.getHeight() - getTextHeight()) / 2);
+		batch->trianglesSetColor(color);
+		if (GLi->quadsSupported())
+		{
+			//a Text keeps 4 vertices per glyph where the renderer takes quads, a glyph is two triangles of it then
+			for (size_t i = 0; i + 3 < mVertices.size(); i += 4)
+			{
+				const VertexCoords* v = &mVertices[i];
+				triangle(batch, x, y, v[0], v[1], v[2]);
+				triangle(batch, x, y, v[0], v[2], v[3]);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i + 2 < mVertices.size(); i += 3)
+			{
+				const VertexCoords* v = &mVertices[i];
+				triangle(batch, x, y, v[0], v[1], v[2]);
+			}
+		}
+	}
+
+  protected:
+	String source;
+	Float wrappedTo = 0;
+
+	static void triangle(BatchRenderer* batch, Float x, Float y, const VertexCoords& a, const VertexCoords& b, const VertexCoords& c)
+	{
+		batch->trianglesSetTexCoord(a.texCoords.x, a.texCoords.y, b.texCoords.x, b.texCoords.y, c.texCoords.x, c.texCoords.y);
+		batch->batchTriangle(x + a.position.x, y + a.position.y, x + b.position.x, y + b.position.y, x + c.position.x, y + c.position.y);
+	}
+};
+
+struct BoardQuestion {
+	int value = 0;
+	std::string text;
+	bool used = false;
+};
+
+struct Board {
+	EE::Window::Window* window = NULL;
+	Font* font = NULL;
+	BatchRenderer* batch = NULL;
+
+	std::string categories[BOARD_COLUMNS];
+	BoardQuestion questions[BOARD_COLUMNS][BOARD_ROWS];
+	int scores[BOARD_PLAYERS] = {};
+	int openColumn = -1; //the question on screen, -1 for the grid
+	int openRow = -1;
+	int wrongPlayer = -1; //had the floor when CMD_WRONG went out, loses the value once it's acked
+
+	//what the last frame showed, only a change in this redraws
+	struct Shown {
+		int width = 0, height = 0;
+		int state = -1, answering = -1, column = -1, row = -1;
+		Uint32 used = 0;
+		int scores[BOARD_PLAYERS] = {};
+
+		bool operator==(const Shown& other) const
+		{
+			return width == other.width && height == other.height && state == other.state && answering == other.answering && column == other.column &&
+				   row == other.row && used == other.used && std::equal(scores, scores + BOARD_PLAYERS, other.scores);
+		}
+	} shown;
+
+	BoardText categoryText[BOARD_COLUMNS];
+	BoardText valueText[BOARD_COLUMNS][BOARD_ROWS];
+	BoardText playerText[BOARD_PLAYERS];
+	BoardText scoreText[BOARD_PLAYERS];
+	BoardText titleText;
+	BoardText questionText;
+
+	Board()
+	{
+		for (int c = 0; c < BOARD_COLUMNS; c++)
+		{
+			categories[c] = "Category " + std::to_string(c + 1);
+			for (int r = 0; r < BOARD_ROWS; r++)
+			{
+				questions[c][r].value = (r + 1) * 200;
+			}
+		}
+	}
+
+	//a category is a line starting with "* ", the questions under it are "<value> <question>", # comments
+	//anything missing keeps its default, so a half written file still gives a full board
+	bool load(const std::string& path)
+	{
+		std::ifstream in(path);
+		if (!in)
+		{
+			return false;
+		}
+		std::string line;
+		int column = -1;
+		int row = 0;
+		while (std::getline(in, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+			if (line.compare(0, 2, "* ") == 0)
+			{
+				if (++column >= BOARD_COLUMNS)
+				{
+					break;
+				}
+				categories[column] = line.substr(2);
+				row = 0;
+			}
+			else if (column >= 0 && row < BOARD_ROWS)
+			{
+				size_t space = line.find(' ');
+				questions[column][row].value = atoi(line.c_str());
+				questions[column][row].text = space == std::string::npos ? "" : line.substr(space + 1);
+				row++;
+			}
+		}
+		return true;
+	}
+
+	//call with the operator window current, it's made current again before this returns
+	void open(Font* boardFont, EE::Window::Window* operatorWindow)
+	{
+		font = boardFont;
+		window = Engine::instance()->createWindow(WindowSettings(1920, 1080, "Jeopardy board"), ContextSettings(true));
+		batch = BatchRenderer::New(8192);
+		batch->setBatchForceRendering(false);
+		for (BoardText* text : texts())
+		{
+			text->setFont(font);
+		}
+		Engine::instance()->setCurrentWindow(operatorWindow);
+		operatorWindow->makeCurrent();
+	}
+
+	std::vector<BoardText*> texts()
+	{
+		std::vector<BoardText*> all = {&titleText, &questionText};
+		for (int c = 0; c < BOARD_COLUMNS; c++)
+		{
+			all.push_back(&categoryText[c]);
+			for (int r = 0; r < BOARD_ROWS; r++)
+			{
+				all.push_back(&valueText[c][r]);
+			}
+		}
+		for (int p = 0; p < BOARD_PLAYERS; p++)
+		{
+			all.push_back(&playerText[p]);
+			all.push_back(&scoreText[p]);
+		}
+		return all;
+	}
+
+	bool isOpen() const
+	{
+		return window && window->isOpen();
+	}
+
+	const BoardQuestion* openQuestion() const
+	{
+		return openColumn >= 0 ? &questions[openColumn][openRow] : NULL;
+	}
+
+	void close(int awardTo)
+	{
+		if (!openQuestion())
+		{
+			return;
+		}
+		if (awardTo >= 0 && awardTo < BOARD_PLAYERS)
+		{
+			scores[awardTo] += questions[openColumn][openRow].value;
+		}
+		questions[openColumn][openRow].used = true;
+		openColumn = openRow = -1;
+	}
+
+	//the controller acked a wrong answer, ran is false when nobody was answering by the time it got there
+	//(the countdown ran out first), nobody loses anything then
+	void wrong(bool ran)
+	{
+		if (ran && openQuestion() && wrongPlayer >= 0 && wrongPlayer < BOARD_PLAYERS)
+		{
+			scores[wrongPlayer] -= questions[openColumn][openRow].value;
+		}
+		wrongPlayer = -1;
+	}
+
+	//left click on the grid opens a question, on an open one gives it to whoever has the floor and closes it,
+	//right click or escape closes it for nobody, F11 toggles fullscreen
+	void input(int answering)
+	{
+		if (!isOpen())
+		{
+			return;
+		}
+		Input* in = window->getInput();
+		in->update();
+		if (in->isKeyUp(KEY_F11))
+		{
+			window->toggleFullscreen();
+		}
+		if (openQuestion())
+		{
+			if (in->mouseRightClicked() || in->isKeyUp(KEY_ESCAPE))
+			{
+				close(-1);
+			}
+			else if (in->mouseLeftClicked())
+			{
+				close(answering);
+			}
+			return;
+		}
+		if (in->mouseLeftClicked())
+		{
+			Vector2i pos = in->getMousePos();
+			Float cellWidth = window->getWidth() / (Float)BOARD_COLUMNS;
+			Float cellHeight = gridHeight() / (BOARD_ROWS + 1);
+			int column = pos.x / cellWidth;
+			int row = (int)(pos.y / cellHeight) - 1; //the first row is the categories
+			if (column >= 0 && column < BOARD_COLUMNS && row >= 0 && row < BOARD_ROWS && !questions[column][row].used)
+			{
+				openColumn = column;
+				openRow = row;
+			}
+		}
+	}
+
+	Float gridHeight() const
+	{
+		return window->getHeight() * 0.84f;
+	}
+
+	//true if it drew
+	bool update(int state, int answering)
+	{
+		if (!isOpen())
+		{
+			return false;
+		}
+		Shown now;
+		now.width = window->getWidth();
+		now.height = window->getHeight();
+		now.state = state;
+		now.answering = answering;
+		now.column = openColumn;
+		now.row = openRow;
+		for (int c = 0; c < BOARD_COLUMNS; c++)
+		{
+			for (int r = 0; r < BOARD_ROWS; r++)
+			{
+				now.used |= (Uint32)questions[c][r].used << (c * BOARD_ROWS + r);
+			}
+		}
+		std::copy(scores, scores + BOARD_PLAYERS, now.scores);
+		if (now == shown)
+		{
+			return false;
+		}
+		shown = now;
+		TraceScope trace("board");
+		EE::Window::Window* operatorWindow = Engine::instance()->getCurrentWindow();
+		Engine::instance()->setCurrentWindow(window);
+		window->makeCurrent();
+		window->setClearColor(RGB(0, 0, 0));
+		window->clear();
+		draw(state, answering);
+		window->display();
+		Engine::instance()->setCurrentWindow(operatorWindow);
+		operatorWindow->makeCurrent();
+		return true;
+	}
+
+	void draw(int state, int answering)
+	{
+		const Color blue(6, 12, 233);
+		const Color darkBlue(3, 6, 140);
+		const Color gold(214, 159, 76);
+		Float width = window->getWidth();
+		Float height = window->getHeight();
+		Float grid = gridHeight();
+		Float pad = std::max(2.0f, height * 0.004f);
+		Float cellWidth = width / BOARD_COLUMNS;
+		Float cellHeight = grid / (BOARD_ROWS + 1);
+		Float playerWidth = width / BOARD_PLAYERS;
+		unsigned int categorySize = cellHeight * 0.22f;
+		unsigned int valueSize = cellHeight * 0.5f;
+		unsigned int nameSize = (height - grid) * 0.2f;
+		unsigned int scoreSize = (height - grid) * 0.36f;
+		unsigned int questionSize = height * 0.06f;
+
+		//text first, the geometry is settled before any of it goes into a batch
+		const BoardQuestion* question = openQuestion();
+		if (question)
+		{
+			titleText.set(categories[openColumn] + " for " + std::to_string(question->value), categorySize);
+			questionText.set(question->text, questionSize, width * 0.85f);
+		}
+		else
+		{
+			for (int c = 0; c < BOARD_COLUMNS; c++)
+			{
+				categoryText[c].set(categories[c], categorySize, cellWidth - pad * 6);
+				for (int r = 0; r < BOARD_ROWS; r++)
+				{
+					valueText[c][r].set("$" + std::to_string(questions[c][r].value), valueSize);
+				}
+			}
+		}
+		for (int p = 0; p < BOARD_PLAYERS; p++)
+		{
+			playerText[p].set("Player " + std::to_string(p + 1), nameSize);
+			scoreText[p].set(std::to_string(scores[p]), scoreSize);
+		}
+
+		//boxes
+		batch->setTexture(NULL);
+		batch->quadsBegin();
+		if (question)
+		{
+			batch->quadsSetColor(blue);
+			batch->batchQuad(Rectf(pad, pad, width - pad, grid - pad));
+		}
+		else
+		{
+			for (int c = 0; c < BOARD_COLUMNS; c++)
+			{
+				for (int r = 0; r <= BOARD_ROWS; r++)
+				{
+					batch->quadsSetColor(r == 0 ? darkBlue : blue);
+					batch->batchQuad(Rectf(c * cellWidth + pad, r * cellHeight + pad, (c + 1) * cellWidth - pad, (r + 1) * cellHeight - pad));
+				}
+			}
+		}
+		for (int p = 0; p < BOARD_PLAYERS; p++)
+		{
+			//the buzz, whoever has the floor lights up
+			batch->quadsSetColor(p == answering ? Color(230, 180, 0) : darkBlue);
+			batch->batchQuad(Rectf(p * playerWidth + pad, grid + pad * 3, (p + 1) * playerWidth - pad, height - pad));
+		}
+		if (state == STATE_ACCEPTING)
+		{
+			batch->quadsSetColor(Color::Green);
+			batch->batchQuad(Rectf(0, grid, width, grid + pad * 2));
+		}
+		batch->draw();
+
+		//text, one batch per size, the sizes can share a texture but don't have to
+		unsigned int sizes[] = {categorySize, valueSize, nameSize, scoreSize, questionSize};
+		for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		{
+			unsigned int size = sizes[i];
+			if (std::find(sizes, sizes + i, size) != sizes + i)
+			{
+				continue;
+			}
+			batch->setTexture(font->getTexture(size));
+			batch->trianglesBegin();
+			if (question)
+			{
+				if (categorySize == size)
+				{
+					titleText.batch(batch, Rectf(pad, pad, width - pad, cellHeight), gold);
+				}
+				if (questionSize == size)
+				{
+					questionText.batch(batch, Rectf(pad, cellHeight, width - pad, grid - pad), Color::White);
+				}
+			}
+			else
+			{
+				for (int c = 0; c < BOARD_COLUMNS; c++)
+				{
+					if (categorySize == size)
+					{
+						categoryText[c].batch(batch, Rectf(c * cellWidth, 0, (c + 1) * cellWidth, cellHeight), Color::White);
+					}
+					for (int r = 0; r < BOARD_ROWS && valueSize == size; r++)
+					{
+						if (!questions[c][r].used)
+						{
+							valueText[c][r].batch(batch, Rectf(c * cellWidth, (r + 1) * cellHeight, (c + 1) * cellWidth, (r + 2) * cellHeight), gold);
+						}
+					}
+				}
+			}
+			for (int p = 0; p < BOARD_PLAYERS; p++)
+			{
+				Float left = p * playerWidth;
+				Float middle = grid + (height - grid) * 0.35f;
+				if (nameSize == size)
+				{
+					playerText[p].batch(batch, Rectf(left, grid + pad * 3, left + playerWidth, middle), Color::White);
+				}
+				if (scoreSize == size)
+				{
+					scoreText[p].batch(batch, Rectf(left, middle, left + playerWidth, height - pad), scores[p] < 0 ? Color::Red : Color::White);
+				}
+			}
+			batch->draw();
+		}
+	}
+};
+
+#endif
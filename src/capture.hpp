@@ -0,0 +1,212 @@
+#ifndef JEOPARDY_CAPTURE_HPP
+#define JEOPARDY_CAPTURE_HPP
+
+#include <eepp/ee.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../arduino/jeopardy/protocol.h"
+#include "clocksync.hpp"
+
+#if EE_PLATFORM == EE_PLATFORM_LINUX
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+//session capture, everything that went over the port with its hostMicros(), so a show can be replayed later
+//the file is a 16 byte header, CAPTURE_MAGIC + format version + PROTO_VERSION + u64 hostMicros() at the start,
+//then records of [kind][len][u32 micros since the previous record] + len bytes, little endian like the protocol
+//a session only ever appends, a capture cut short by a crash is fine up to its last whole record
+#define CAPTURE_MAGIC "JPDCAP"
+#define CAPTURE_FORMAT 1
+#define CAPTURE_HEADER 16
+#define CAPTURE_RECORD_HEADER 6
+#define CAPTURE_FLUSH_BYTES 65536 //written out at this much or whenever the serial thread goes to sleep
+
+#define CAPTURE_READ 1 //bytes as they came off the port, one read (reads are never over 255 bytes)
+#define CAPTURE_WRITE 2 //a frame sent to the controller
+#define CAPTURE_OPENED 3 //the device path
+#define CAPTURE_LOST 4 //the port went away
+//a gap too long for the u32 is an empty CAPTURE_READ with the delta maxed out, as many as it takes
+
+struct CaptureRecord {
+	Uint8 kind;
+	Uint8 len;
+	Int64 time; //hostMicros() when it was recorded
+	const Uint8* data; //points into the mapped file
+};
+
+//serial thread only
+struct CaptureWriter {
+	int fd = -1;
+	std::vector<Uint8> buffer;
+	Int64 last = 0;
+
+	bool open(const std::string& path)
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+			if (fd < 0)
+			{
+				return false;
+			}
+			last = hostMicros();
+			Uint8 header[CAPTURE_HEADER];
+			memcpy(header, CAPTURE_MAGIC, 6);
+			header[6] = CAPTURE_FORMAT;
+			header[7] = PROTO_VERSION;
+			protoPutU32(header + 8, (Uint64)last);
+			protoPutU32(header + 12, (Uint64)last >> 32);
+			buffer.reserve(CAPTURE_FLUSH_BYTES + 512);
+			buffer.insert(buffer.end(), header, header + CAPTURE_HEADER);
+			flush();
+		#endif
+		return fd >= 0;
+	}
+
+	void add(Uint8 kind, const Uint8* data, size_t len, Int64 time)
+	{
+		if (fd < 0)
+		{
+			return;
+		}
+		do
+		{
+			Uint8 n = std::min<size_t>(len, 255);
+			Int64 delta = time - last;
+			while (delta > 0xFFFFFFFFll)
+			{
+				record(CAPTURE_READ, NULL, 0, 0xFFFFFFFFu);
+				delta -= 0xFFFFFFFFll;
+			}
+			record(kind, data, n, std::max<Int64>(delta, 0));
+			last = time;
+			data += n;
+			len -= n;
+		} while (len);
+		if (buffer.size() >= CAPTURE_FLUSH_BYTES)
+		{
+			flush();
+		}
+	}
+
+	void record(Uint8 kind, const Uint8* data, Uint8 len, Uint32 delta)
+	{
+		Uint8 header[CAPTURE_RECORD_HEADER] = {kind, len};
+		protoPutU32(header + 2, delta);
+		buffer.insert(buffer.end(), header, header + CAPTURE_RECORD_HEADER);
+		buffer.insert(buffer.end(), data, data + len);
+	}
+
+	void flush()
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			if (fd >= 0 && !buffer.empty() && ::write(fd, buffer.data(), buffer.size()) < 0)
+			{
+				std::cout<<"Capture write failed, recording stopped\n";
+				close();
+			}
+		#endif
+		buffer.clear();
+	}
+
+	void close()
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			if (fd >= 0)
+			{
+				int closing = fd;
+				fd = -1;
+				if (!buffer.empty() && ::write(closing, buffer.data(), buffer.size()) < 0) {}
+				::close(closing);
+			}
+		#endif
+		buffer.clear();
+	}
+};
+
+//walks a capture straight out of the page cache, records point into the mapping and nothing is copied
+struct CaptureReader {
+	const Uint8* base = NULL;
+	size_t size = 0;
+	size_t pos = 0;
+	Int64 time = 0;
+
+	bool open(const std::string& path)
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+			{
+				return false;
+			}
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size >= CAPTURE_HEADER)
+			{
+				void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (map != MAP_FAILED)
+				{
+					base = (const Uint8*)map;
+					size = st.st_size;
+					madvise(map, size, MADV_SEQUENTIAL);
+				}
+			}
+			::close(fd);
+		#endif
+		if (!base || memcmp(base, CAPTURE_MAGIC, 6) != 0 || base[6] != CAPTURE_FORMAT)
+		{
+			close();
+			return false;
+		}
+		time = protoGetU32(base + 8) | ((Int64)protoGetU32(base + 12) << 32);
+		pos = CAPTURE_HEADER;
+		return true;
+	}
+
+	//PROTO_VERSION of the session, the frames in it are only understood by a host that speaks the same
+	Uint8 protocol() const
+	{
+		return base[7];
+	}
+
+	//false at the end, or at a record the capture was cut off in
+	//another session appended to the same file starts with its own header, it's skipped and its clock taken
+	bool next(CaptureRecord& record)
+	{
+		while (pos + CAPTURE_HEADER <= size && memcmp(base + pos, CAPTURE_MAGIC, 6) == 0)
+		{
+			time = protoGetU32(base + pos + 8) | ((Int64)protoGetU32(base + pos + 12) << 32);
+			pos += CAPTURE_HEADER;
+		}
+		if (pos + CAPTURE_RECORD_HEADER > size || pos + CAPTURE_RECORD_HEADER + base[pos + 1] > size)
+		{
+			return false;
+		}
+		record.kind = base[pos];
+		record.len = base[pos + 1];
+		time += protoGetU32(base + pos + 2);
+		record.time = time;
+		record.data = base + pos + CAPTURE_RECORD_HEADER;
+		pos += CAPTURE_RECORD_HEADER + record.len;
+		return true;
+	}
+
+	void close()
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			if (base)
+			{
+				munmap((void*)base, size);
+			}
+		#endif
+		base = NULL;
+		size = 0;
+	}
+};
+
+#endif
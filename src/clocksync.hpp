@@ -0,0 +1,131 @@
+#ifndef JEOPARDY_CLOCKSYNC_HPP
+#define JEOPARDY_CLOCKSYNC_HPP
+
+#include <eepp/ee.hpp>
+#include <chrono>
+#include <cmath>
+#include <deque>
+
+//host monotonic clock in microseconds, everything that gets timestamped on the PC side uses this
+inline Int64 hostMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//maps the firmware's micros() onto hostMicros()
+//every ping gives a sample (firmware time, host time halfway through the round trip), the mapping is a
+//least squares line through the recent samples with the shortest round trips, so it tracks offset and drift
+struct ClockSync {
+	struct Sample {
+		Int64 fw;
+		Int64 host;
+		Int64 rtt;
+	};
+
+	static const size_t WINDOW = 64;
+
+	std::deque<Sample> samples;
+	Int64 lastFw = 0; //unwrapped firmware time of the last sample
+	Uint32 lastFwRaw = 0;
+
+	//fit host = base + (fw - fwBase) * slope
+	bool valid = false;
+	Int64 fwBase = 0;
+	double base = 0;
+	double slope = 1;
+	double error = 0; //error bound in micros
+
+	void reset()
+	{
+		samples.clear();
+		valid = false;
+	}
+
+	//micros() wraps every ~71 minutes, take the 64 bit value closest to the last sample
+	Int64 unwrap(Uint32 fw) const
+	{
+		return lastFw + (Int32)(fw - lastFwRaw);
+	}
+
+	void addSample(Int64 hostSend, Int64 hostRecv, Uint32 fwRaw)
+	{
+		Int64 fw = samples.empty() ? fwRaw : unwrap(fwRaw);
+		Int64 host = hostSend + (hostRecv - hostSend) / 2;
+
+		//a firmware reset or a different board shows up as a sample way off the line, start over
+		if (valid && std::abs(toHost(fw) - host) > 100000)
+		{
+			reset();
+			fw = fwRaw;
+		}
+		lastFw = fw;
+		lastFwRaw = fwRaw;
+
+		samples.push_back({fw, host, hostRecv - hostSend});
+		if (samples.size() > WINDOW)
+		{
+			samples.pop_front();
+		}
+		fit();
+	}
+
+	void fit()
+	{
+		Int64 minRtt = samples.front().rtt;
+		for (const Sample& s : samples)
+		{
+			minRtt = std::min(minRtt, s.rtt);
+		}
+
+		//slow round trips were delayed somewhere, their midpoint says little about when the firmware answered
+		fwBase = samples.front().fw;
+		Int64 hostBase = samples.front().host;
+		double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+		for (const Sample& s : samples)
+		{
+			if (s.rtt <= 2*minRtt + 200)
+			{
+				double x = s.fw - fwBase;
+				double y = s.host - hostBase;
+				n++;
+				sx += x;
+				sy += y;
+				sxx += x*x;
+				sxy += x*y;
+			}
+		}
+		double den = n*sxx - sx*sx;
+		slope = (n >= 8 && den > 0) ? (n*sxy - sx*sy) / den : 1; //too few points for a drift estimate yet
+		base = hostBase + (sy - slope*sx) / n;
+
+		double residual = 0;
+		for (const Sample& s : samples)
+		{
+			if (s.rtt <= 2*minRtt + 200)
+			{
+				double r = s.host - (base + (s.fw - fwBase)*slope);
+				residual += r*r;
+			}
+		}
+		error = minRtt/2.0 + std::sqrt(residual / n);
+		valid = true;
+	}
+
+	Int64 toHost(Int64 fw) const
+	{
+		return base + (fw - fwBase)*slope;
+	}
+
+	Int64 toHost(Uint32 fwRaw) const
+	{
+		return toHost(unwrap(fwRaw));
+	}
+
+	//how fast the firmware clock runs compared to the host one
+	double driftPpm() const
+	{
+		return (1/slope - 1) * 1e6;
+	}
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef JEOPARDY_LATENCY_HPP
+#define JEOPARDY_LATENCY_HPP
+
+#include <eepp/ee.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../arduino/jeopardy/protocol.h"
+
+//press to screen latency of a buzz, split into the stages it goes through, all hostMicros()
+//the press time is only exact when the controller's micros() is our clock, like the emulator's is, so this is
+//for JpController --bench-latency against jeopardyemu:
+//  bin/linux/jeopardyemu --script bench/buzz.script --link /tmp/ttyEMU0 &
+//  bin/linux/JpController --no-record --bench-latency 2000 latency.json /tmp/ttyEMU0
+struct BuzzTrace {
+	Int64 press = 0; //the press, from MSG_BUZZ
+	Int64 read = 0; //the read the frame finished in returned
+	Int64 parsed = 0; //the frame came out of the decoder
+	Int64 handled = 0; //the ui took it in, state changed
+	Int64 sound = 0; //answer.play() returned
+	Int64 shown = 0; //win->display() of the first frame with it returned
+};
+
+#define LATENCY_STAGES 6
+
+struct LatencyBench {
+	//stage i runs from time i to time i+1 of a trace, the last one is the whole thing
+	const char* stageNames[LATENCY_STAGES] = {"wire", "parse", "ui_queue", "sound", "display", "total"};
+
+	int trials = 0; //to run, 0 if not benchmarking
+	std::string path;
+	int failed = 0;
+	std::vector<Int64> samples[LATENCY_STAGES];
+
+	//per trial, see JpController's benchStep()
+	enum Phase { READY, OPEN, DONE } phase = READY;
+	Int64 phaseStart = 0;
+	BuzzTrace trace;
+
+	bool active() const
+	{
+		return trials > 0 && phase != DONE;
+	}
+
+	int done() const
+	{
+		return samples[0].size();
+	}
+
+	void add(const BuzzTrace& t)
+	{
+		Int64 times[LATENCY_STAGES] = {t.press, t.read, t.parsed, t.handled, t.sound, t.shown};
+		for (int i = 0; i < LATENCY_STAGES - 1; i++)
+		{
+			samples[i].push_back(times[i + 1] - times[i]);
+		}
+		samples[LATENCY_STAGES - 1].push_back(t.shown - t.press);
+	}
+
+	//nearest rank, sorts a copy
+	static Int64 percentile(std::vector<Int64> values, double p)
+	{
+		if (values.empty())
+		{
+			return 0;
+		}
+		std::sort(values.begin(), values.end());
+		size_t rank = std::min(values.size() - 1, (size_t)(p / 100 * values.size()));
+		return values[rank];
+	}
+
+	std::string summary() const
+	{
+		std::string text;
+		for (int i = 0; i < LATENCY_STAGES; i++)
+		{
+			char line[128];
+			snprintf(line, sizeof(line), "%-9s p50 %7lld  p95 %7lld  p99 %7lld  max %7lld us\n", stageNames[i], (long long)percentile(samples[i], 50),
+					 (long long)percentile(samples[i], 95), (long long)percentile(samples[i], 99), (long long)percentile(samples[i], 100));
+			text += line;
+		}
+		return text;
+	}
+
+	//one json object, the percentiles per stage and every sample, so builds can be diffed or replotted
+	bool write() const
+	{
+		FILE* out = fopen(path.c_str(), "w");
+		if (!out)
+		{
+			return false;
+		}
+		fprintf(out, "{\n  \"build\": {\"compiler\": \"%s\", \"built\": \"%s %s\", \"protocol\": %d},\n", __VERSION__, __DATE__, __TIME__, PROTO_VERSION);
+		fprintf(out, "  \"unit\": \"us\",\n  \"trials\": %d,\n  \"failed\": %d,\n  \"stages\": {\n", done(), failed);
+		for (int i = 0; i < LATENCY_STAGES; i++)
+		{
+			double mean = 0;
+			for (Int64 v : samples[i])
+			{
+				mean += v;
+			}
+			mean /= std::max<size_t>(samples[i].size(), 1);
+			fprintf(out, "    \"%s\": {\"mean\": %.1f, \"p50\": %lld, \"p95\": %lld, \"p99\": %lld, \"max\": %lld}%s\n", stageNames[i], mean,
+					(long long)percentile(samples[i], 50), (long long)percentile(samples[i], 95), (long long)percentile(samples[i], 99),
+					(long long)percentile(samples[i], 100), i < LATENCY_STAGES - 1 ? "," : "");
+		}
+		fprintf(out, "  },\n  \"samples\": {\n");
+		for (int i = 0; i < LATENCY_STAGES; i++)
+		{
+			fprintf(out, "    \"%s\": [", stageNames[i]);
+			for (size_t j = 0; j < samples[i].size(); j++)
+			{
+				fprintf(out, "%s%lld", j ? "," : "", (long long)samples[i][j]);
+			}
+			fprintf(out, "]%s\n", i < LATENCY_STAGES - 1 ? "," : "");
+		}
+		fprintf(out, "  }\n}\n");
+		return fclose(out) == 0;
+	}
+};
+
+#endif
@@ -2,16 +2,21 @@
 #include <eepp/ui/doc/syntaxdefinitionmanager.hpp>
 #include <eepp/ui/doc/syntaxtokenizer.hpp>
 #include <eepp/ui/doc/textdocument.hpp>
+#include <algorithm>
+#include <ctime>
 #include <filesystem>
 #include <iostream>
 #include <future>
 #include <vector>
 
-#if EE_PLATFORM == EE_PLATFORM_LINUX
-	#include <CppLinuxSerial/SerialPort.hpp>
-#endif
-#if EE_PLATFORM == EE_PLATFORM_WINDOWS
-#endif
+#include "../arduino/jeopardy/protocol.h"
+#include "board.hpp"
+#include "clocksync.hpp"
+#include "latency.hpp"
+#include "perfhud.hpp"
+#include "rawlog.hpp"
+#include "serialio.hpp"
+#include "trace.hpp"
 
 
 using namespace EE::UI::Doc;
@@ -25,15 +30,23 @@ EE::Window::Window* win = NULL;
 UIPushButton* acceptButton;
 UIPushButton* stopAcceptButton;
 UIPushButton* cancelButton;
+UIPushButton* wrongButton;
 UIPushButton* testButton;
 UIPushButton* rescanButton;
+UIPushButton* findButton;
 
 //port selector text view
 UIDropDownList* portSelector;
 
-//status views
-UITextView* rawOut;
+//status views, only touched when what they show changed, an idle ui never redraws
 UITextView* statusOut;
+bool statusChanged = true; //set by whatever changes something statusText() shows
+String shownStatus;
+String clockText; //clock sync line, only redone when the numbers moved enough to matter
+
+//raw traffic console, see rawlog.hpp
+UIListView* rawList;
+std::shared_ptr<RawLogModel> rawLog = RawLogModel::New();
 
 //sounds
 SoundBuffer answerBuf;
@@ -44,30 +57,86 @@ Sound timeout;
 
 //game status
 int statusState = 0;
+std::string portName; //port the serial thread has open
+int answeringPlayer = -1;
+Uint32 answeringDelta = 0; //micros between answers opening and the winning press
+Int64 answeringPressTime = 0; //hostMicros() of the press, 0 if the clock wasn't synced yet
+
+//presses of the last round, ranked
+struct Press {
+	int player;
+	Uint8 flags;
+	Uint32 delta; //micros since answers opened
+};
+std::vector<Press> lastRound;
+String roundText;
+
+//reaction time stats per player over the whole session
+int pressCount[5] = {0,0,0,0,0};
+Uint64 pressTotal[5] = {0,0,0,0,0};
+Uint32 pressBest[5] = {0,0,0,0,0};
+
+//serial control, the port itself lives on the serial thread
+SerialIO serialIO;
+Clock heartbeatClock; //time since the last valid frame
+Uint32 reportedDrops = 0;
+String commandText; //how the last game command went
+int ackCount = 0;
+Int64 ackTotal = 0; //micros, click to ack
+Int64 ackMax = 0;
+
+//clock sync with the firmware
+ClockSync clockSync;
+
+//--bench-latency, see latency.hpp
+LatencyBench bench;
+
+//F3 overlay, see perfhud.hpp
+PerfHud perfHud;
+
+//audience window, --board, see board.hpp
+Board board;
+
+//wakes mainLoop() out of waitEvent() as soon as the serial thread has something, focused or not
+//eepp doesn't ship SDL's headers, with SDL's own installed any pushed event wakes the wait up,
+//without them mainLoop() polls every 16 ms instead (see waitMs()) and a buzz can wait that long, install SDL2's
+//development headers for the real thing
+#if __has_include(<SDL2/SDL_events.h>)
+	#include <SDL2/SDL_events.h>
+	#define WAKE_EVENTS 1
+#else
+	#warning "SDL2/SDL_events.h not found, serial events won't wake the main loop, it polls every 16 ms instead"
+	#define WAKE_EVENTS 0
+#endif
 
-//serial control
-#if EE_PLATFORM == EE_PLATFORM_LINUX
+void wakeMainLoop()
+{
+	#if WAKE_EVENTS
+		SDL_Event event;
+		SDL_zero(event);
+		event.type = SDL_USEREVENT;
+		SDL_PushEvent(&event);
+	#endif
+}
 
-	mn::CppLinuxSerial::SerialPort sPort("", mn::CppLinuxSerial::BaudRate::B_9600);
-#endif
-#if EE_PLATFORM == EE_PLATFORM_WINDOWS
-	HANDLE sPort;
-#endif
+//waitEvent() timeout, only paces the ui and the heartbeat check when serial events wake it up on their own
+int waitMs()
+{
+	#if WAKE_EVENTS
+		return win->hasFocus() ? 16 : HEARTBEAT_MS;
+	#else
+		return 16; //nothing wakes it, this is how late a buzz can be handled
+	#endif
+}
 
 std::vector<String> getPorts()
 {
 	std::vector<String> ports;
-	//linux implementation
-	#if EE_PLATFORM == EE_PLATFORM_LINUX
-		std::string path = "/dev";
-		for (const auto & entry : std::filesystem::directory_iterator(path))
-		{
-			if (entry.path().u8string().find("USB") != std::string::npos)
-			{	
-				ports.push_back(entry.path().u8string());
-			}
-		}
-	#endif
+	//linux implementation, see ports.hpp
+	for (const std::string& port : listPorts())
+	{
+		ports.push_back(port);
+	}
 	
 	//windows implementation
 	return ports;
@@ -77,111 +146,489 @@ void openSerial(String port)
 {
 	if (port!="")
 	{
-		#if EE_PLATFORM == EE_PLATFORM_LINUX
-			sPort.SetBaudRate(9600);
-			sPort.SetDevice(port);
-			sPort.Open();
-		#endif
-		#if EE_PLATFORM == EE_PLATFORM_WINDOWS
-		#endif
+		serialIO.openPort(port.toUtf8());
 	}
 }
 
 void closeSerial()
 {
-	#if EE_PLATFORM == EE_PLATFORM_LINUX
-		if (sPort.GetState()==mn::CppLinuxSerial::State::OPEN)
+	serialIO.stop();
+}
+
+const char* commandName(Uint8 opcode)
+{
+	switch (opcode)
+	{
+		case CMD_ACCEPT: return "Accept answers";
+		case CMD_STOP: return "Stop";
+		case CMD_CANCEL: return "Cancel answer";
+		case CMD_TEST: return "Test mode";
+		case CMD_WRONG: return "Wrong answer";
+	}
+	return "?";
+}
+
+//game commands, the buttons only change once the controller acks, see handleAck()
+void sendSerial(Uint8 opcode)
+{
+	if (serialIO.open)
+	{
+		if (opcode==CMD_WRONG)
 		{
-			sPort.Close();
+			board.wrongPlayer = answeringPlayer;
 		}
-	#endif
+		serialIO.sendAcked(opcode);
+	}
+	else
+	{
+		commandText = String("\n") + commandName(opcode) + ": not sent, no controller";
+		statusChanged = true;
+	}
 }
-void sendSerial(String text)
+
+
+
+
+
+void handleRound(const ProtoMessage& msg)
 {
-	#if EE_PLATFORM == EE_PLATFORM_LINUX
-		if (sPort.GetState()==mn::CppLinuxSerial::State::OPEN)
+	if (msg.len < 1 || msg.len < 1 + msg.payload[0]*6)
+	{
+		return;
+	}
+	lastRound.clear();
+	for (int i = 0; i < msg.payload[0]; i++)
+	{
+		const Uint8* entry = &msg.payload[1 + i*6];
+		if (entry[0] < 5)
 		{
-			sPort.Write(text);
+			lastRound.push_back({entry[0], entry[1], protoGetU32(&entry[2])});
 		}
-	#endif
+	}
+	//timed presses first, fastest first, then the ones that only jumped the gun
+	std::sort(lastRound.begin(), lastRound.end(), [](const Press& a, const Press& b) {
+		bool aTimed = a.flags & PRESS_TIMED;
+		bool bTimed = b.flags & PRESS_TIMED;
+		if (aTimed != bTimed)
+		{
+			return aTimed;
+		}
+		return a.delta < b.delta;
+	});
+
+	roundText = lastRound.empty() ? "\nLast round: no presses" : "\nLast round:";
+	int rank = 1;
+	for (const Press& press : lastRound)
+	{
+		if (!(press.flags & PRESS_TIMED))
+		{
+			roundText += String::format("\n-  Player %d: early", press.player+1);
+			continue;
+		}
+		pressCount[press.player]++;
+		pressTotal[press.player] += press.delta;
+		if (pressCount[press.player]==1 || press.delta < pressBest[press.player])
+		{
+			pressBest[press.player] = press.delta;
+		}
+		roundText += String::format("\n%d. Player %d: %.3f ms", rank++, press.player+1, press.delta/1000.0);
+		if (press.flags & PRESS_WINNER)
+		{
+			roundText += " (answered)";
+		}
+		else
+		{
+			roundText += String::format(" (+%u us)", (unsigned)(press.delta - lastRound[0].delta));
+		}
+		if (press.flags & PRESS_WRONG)
+		{
+			roundText += " wrong";
+		}
+		if (press.flags & PRESS_EARLY)
+		{
+			roundText += " early";
+		}
+		roundText += String::format(", avg %.1f ms, best %.1f ms", pressTotal[press.player]/1000.0/pressCount[press.player], pressBest[press.player]/1000.0);
+	}
+	std::cout<<roundText.toUtf8()<<"\n";
+	statusChanged = true;
 }
 
-String readSerial()
+//recvTime is the hostMicros() of the read the frame arrived in, parseTime when it was decoded
+void handleMessage(const ProtoMessage& msg, Int64 recvTime, Int64 parseTime)
 {
-	std::string readData;
-	#if EE_PLATFORM == EE_PLATFORM_LINUX
-		if (sPort.GetState()==mn::CppLinuxSerial::State::OPEN)
-		{
-			try
+	TraceScope trace("message", msg.opcode);
+	heartbeatClock.restart();
+	switch (msg.opcode)
+	{
+		case MSG_STATE:
+		case MSG_HEARTBEAT:
+			if (msg.len < 1 || msg.payload[0] < STATE_IDLE || msg.payload[0] > STATE_TESTING)
+			{
+				break;
+			}
+			if (msg.payload[0]==STATE_ANSWERING && statusState!=STATE_ANSWERING && answeringPlayer<0) //buzz frame got lost
+			{
+				answer.play();
+				acceptButton->setBackgroundColor(Color::gray);
+			}
+			if (msg.payload[0]==STATE_ACCEPTING && statusState==STATE_ANSWERING) //wrong answer with an empty queue, answers are open again
+			{
+				acceptButton->setBackgroundColor(Color::lime);
+			}
+			if (msg.payload[0]!=STATE_ANSWERING)
+			{
+				answeringPlayer = -1;
+			}
+			if (statusState!=msg.payload[0])
+			{
+				statusState = msg.payload[0];
+				statusChanged = true;
+			}
+			break;
+		case MSG_BUZZ:
+			if (msg.len < 9)
+			{
+				break;
+			}
+			//sent for the first buzz of a round and again for every handover after a wrong answer
+			acceptButton->setBackgroundColor(Color::gray);
+			answeringPlayer = msg.payload[0];
+			answeringDelta = protoGetU32(&msg.payload[1]);
+			answeringPressTime = 0;
+			statusChanged = true;
+			if (bench.active() && bench.phase==LatencyBench::OPEN && !bench.trace.press)
+			{
+				//the emulator's micros() is hostMicros(), the press time only needs unwrapping
+				bench.trace.press = recvTime - (Uint32)((Uint32)recvTime - protoGetU32(&msg.payload[5]));
+				bench.trace.read = recvTime;
+				bench.trace.parsed = parseTime;
+				bench.trace.handled = hostMicros();
+				TraceScope sound("answer.play");
+				answer.play();
+				bench.trace.sound = hostMicros();
+				perfHud.addBuzz(bench.trace.sound - bench.trace.press);
+			}
+			else
+			{
+				TraceScope sound("answer.play");
+				answer.play();
+				//a replay's times are the capture's clock, not comparable to hostMicros() now
+				if (clockSync.valid && serialIO.replayPath.empty())
+				{
+					perfHud.addBuzz(hostMicros() - clockSync.toHost(protoGetU32(&msg.payload[5])));
+				}
+			}
+			if (clockSync.valid)
+			{
+				answeringPressTime = clockSync.toHost(protoGetU32(&msg.payload[5]));
+			}
+			if (clockSync.valid && serialIO.replayPath.empty())
+			{
+				std::cout<<"Buzz from player "<<answeringPlayer+1<<" read "<<(recvTime-answeringPressTime)<<" us after the press (+-"<<(int)clockSync.error<<" us), handled "<<(hostMicros()-recvTime)<<" us after the read\n";
+			}
+			break;
+		case MSG_PRESSES:
+			handleRound(msg);
+			break;
+		case MSG_PONG:
+			if (msg.len >= 8)
 			{
-				sPort.Read(readData);
+				//the tag is the low 32 bits of the send time
+				Int64 sendTime = recvTime - (Uint32)((Uint32)recvTime - protoGetU32(&msg.payload[0]));
+				clockSync.addSample(sendTime, recvTime, protoGetU32(&msg.payload[4]));
 			}
-			catch(std::system_error){
-				std::cout<<"Serial port address is bad, port disconnected?\n";
-				statusState = 5;
-				std::cout<<"Attempting to close port\n";
-				sPort.Close();
-				portSelector->getListBox()->clear();
-				portSelector->getListBox()->addListBoxItems(getPorts());
+			break;
+	}
+}
+
+//the controller ran a command, ack is [seq][opcode][state after it]
+void handleAck(const SerialEvent& event)
+{
+	Uint8 opcode = event.msg.payload[1];
+	Uint8 state = event.msg.payload[2];
+	Uint8 before = event.msg.payload[3]; //an ack doesn't mean the command did anything, this does
+	switch (opcode)
+	{
+		case CMD_ACCEPT:
+			if (state==STATE_ACCEPTING)
+			{
+				acceptButton->setBackgroundColor(Color::lime);
 			}
+			break;
+		case CMD_TEST:
+			if (state==STATE_TESTING)
+			{
+				testButton->setBackgroundColor(Color::lime);
+			}
+			break;
+		case CMD_WRONG:
+			board.wrong(before==STATE_ANSWERING);
+			break;
+		case CMD_STOP:
+			if (before!=STATE_IDLE)
+			{
+				acceptButton->setBackgroundColor(Color::gray);
+				testButton->setBackgroundColor(Color::gray);
+				TraceScope sound("timeout.play");
+				timeout.play();
+			}
+			break;
+	}
+	ackCount++;
+	ackTotal += event.latency;
+	ackMax = std::max(ackMax, event.latency);
+	commandText = String::format("\n%s: acked in %.2f ms", commandName(opcode), event.latency/1000.0);
+	if (event.tries > 1)
+	{
+		commandText += String::format(" after %d tries", event.tries);
+	}
+	commandText += String::format(" (avg %.2f ms, max %.2f ms)", ackTotal/1000.0/ackCount, ackMax/1000.0);
+	statusChanged = true;
+}
+
+//one trial after the other: accept, the emulator presses, the buzz gets on screen, cancel, back to idle
+void benchStep()
+{
+	if (!bench.active() || !serialIO.open)
+	{
+		return;
+	}
+	Int64 now = hostMicros();
+	if (bench.phase==LatencyBench::READY)
+	{
+		if (statusState==STATE_IDLE)
+		{
+			bench.trace = BuzzTrace();
+			bench.phase = LatencyBench::OPEN;
+			bench.phaseStart = now;
+			sendSerial(CMD_ACCEPT);
 		}
-	#endif
-	return readData;
+		else if (now - bench.phaseStart > 1000000)
+		{
+			bench.phaseStart = now;
+			sendSerial(CMD_STOP); //still testing or in a round from before
+		}
+	}
+	else if (bench.trace.shown)
+	{
+		bench.add(bench.trace);
+		bench.phase = LatencyBench::READY;
+		bench.phaseStart = now;
+		sendSerial(CMD_CANCEL);
+	}
+	else if (now - bench.phaseStart > 2000000)
+	{
+		bench.failed++;
+		bench.phase = LatencyBench::READY;
+		bench.phaseStart = now;
+		sendSerial(CMD_STOP);
+	}
+
+	if (bench.done() + bench.failed >= bench.trials)
+	{
+		bench.phase = LatencyBench::DONE;
+		std::cout<<"Buzz latency over "<<bench.done()<<" trials ("<<bench.failed<<" failed):\n"<<bench.summary();
+		if (!bench.write())
+		{
+			std::cout<<"Can't write "<<bench.path<<"\n";
+		}
+		win->close();
+	}
 }
 
+String statusStrings[10] = {"Waiting for initialization","Idle","Accepting answers","Answering...","Testing mode","Bad port, USB disconnected?","Controller not responding","USB disconnected, reconnecting...","No controller found, pick a port","Looking for the controller..."};
 
+void setStatus(int state)
+{
+	if (statusState!=state)
+	{
+		statusState = state;
+		statusChanged = true;
+	}
+}
 
+String statusText()
+{
+	String status = "Status: "+statusStrings[statusState];
+	if (statusState==STATE_ANSWERING && answeringPlayer>=0)
+	{
+		status += String::format(" player %d (%.3f ms)", answeringPlayer+1, answeringDelta/1000.0);
+	}
+	if (serialIO.open)
+	{
+		status += "\nPort: "+portName+" ("+serialIO.tuning()+")";
+	}
+	else if (!serialIO.replayPath.empty())
+	{
+		status += "\nReplay of "+serialIO.replayPath+" ("+portName+")";
+	}
+	return status+clockText+commandText+roundText;
+}
 
+//every ping moves the estimate a little, the line only changes when it's off by a quarter or 2 ppm
+void updateClockText()
+{
+	static double shownError = -1;
+	static double shownDrift = 0;
+	if (!clockSync.valid)
+	{
+		if (!clockText.empty())
+		{
+			clockText = "";
+			shownError = -1;
+			statusChanged = true;
+		}
+		return;
+	}
+	double drift = clockSync.driftPpm();
+	if (shownError < 0 || std::abs(clockSync.error - shownError) > std::max(5.0, shownError/4) || std::abs(drift - shownDrift) > 2)
+	{
+		shownError = clockSync.error;
+		shownDrift = drift;
+		clockText = String::format("\nClock sync: +-%.0f us, drift %.0f ppm", shownError, shownDrift);
+		statusChanged = true;
+	}
+}
 
-String statusStrings[6] = {"Waiting for initialization","Idle","Accepting answers","Answering...","Testing mode","Bad port, USB disconnected?"};
 void mainLoop() {
+	Int64 passStart = hostMicros();
 	win->getInput()->update();
+	if (win->getInput()->isKeyUp(KEY_F3))
+	{
+		perfHud.toggle();
+	}
+	if (win->getInput()->isKeyUp(KEY_F4) && tracer().enabled)
+	{
+		std::cout<<(tracer().write() ? "Trace written to " : "Can't write the trace to ")<<tracer().path<<"\n";
+	}
+	board.input(statusState==STATE_ANSWERING ? answeringPlayer : -1);
 	
-	String readText = "";
-	//serial port reading
-	#if EE_PLATFORM == EE_PLATFORM_LINUX
-		if (sPort.GetState()==mn::CppLinuxSerial::State::OPEN)
+	//everything the serial thread has for us, never waits on it
+	SerialEvent event;
+	serialIO.drained();
+	{
+		PerfScope scope(perfHud.frame.serial);
+		TraceScope trace("serial events");
+		while (serialIO.poll(event))
 		{
-			readText = readSerial();
+			perfHud.frame.events++;
+			switch (event.type)
+			{
+				case SerialEvent::MESSAGE:
+					handleMessage(event.msg, event.time, event.parsed);
+					rawLog->add(event);
+					perfHud.addMessage(event.parsed - event.time);
+					break;
+				case SerialEvent::RAW:
+					rawLog->add(event);
+					perfHud.addRead(event.rawLen);
+					break;
+				case SerialEvent::OPENED:
+					portName = std::string((const char*)event.raw, event.rawLen);
+					std::cout<<"Opened "<<portName<<"\n";
+					heartbeatClock.restart();
+					clockSync.reset();
+					statusState = 0;
+					statusChanged = true;
+					break;
+				case SerialEvent::LOST:
+					setStatus(5);
+					portSelector->getListBox()->clear();
+					portSelector->getListBox()->addListBoxItems(getPorts());
+					break;
+				case SerialEvent::RECONNECTING:
+					setStatus(7);
+					acceptButton->setBackgroundColor(Color::gray);
+					testButton->setBackgroundColor(Color::gray);
+					break;
+				case SerialEvent::PORTS:
+					portSelector->getListBox()->clear();
+					portSelector->getListBox()->addListBoxItems(getPorts());
+					break;
+				case SerialEvent::NOT_FOUND:
+					setStatus(8);
+					break;
+				case SerialEvent::ACKED:
+					handleAck(event);
+					break;
+				case SerialEvent::FAILED:
+					commandText = String("\n") + commandName(event.msg.opcode) + String::format(": not acked after %d tries, try again", event.tries);
+					statusChanged = true;
+					std::cout<<commandName(event.msg.opcode)<<" wasn't acked after "<<(int)event.tries<<" tries\n";
+					break;
+			}
 		}
-	#endif
-	
-	if (readText.contains("idle"))
+	}
+	benchStep();
+	if (serialIO.droppedEvents!=reportedDrops)
 	{
-		statusState = 1;
+		reportedDrops = serialIO.droppedEvents;
+		std::cout<<"Serial events dropped, "<<reportedDrops<<" so far\n";
 	}
-	else if (readText.contains("accepting"))
+	
+	//missed heartbeats mean the controller is gone even if the port is still open
+	if (serialIO.open && statusState!=6 && heartbeatClock.getElapsedTime()>Milliseconds(HEARTBEAT_TIMEOUT_MS))
 	{
-		statusState = 2;
+		std::cout<<"No heartbeat from the controller\n";
+		setStatus(6);
+		acceptButton->setBackgroundColor(Color::gray);
+		testButton->setBackgroundColor(Color::gray);
 	}
-	else if (readText.contains("answering"))
+	
+	//same pass as the events, a buzz is on the board before the operator panel is even drawn
+	board.update(statusState, statusState==STATE_ANSWERING ? answeringPlayer : -1);
+	
+	//the panels are only set when their text really differs, setText() invalidates the scene and costs a redraw
+	updateClockText();
+	if (statusChanged)
 	{
-		if (statusState!=3)
+		statusChanged = false;
+		String status = statusText();
+		if (status!=shownStatus)
 		{
-			answer.play();
-			acceptButton->setBackgroundColor(Color::gray);
+			shownStatus = status;
+			statusOut->setText(shownStatus);
 		}
-		statusState = 3;
 	}
-	else if (readText.contains("testing"))
+	//keepalives are hidden by default, an idle line adds no rows and costs no redraw
+	if (rawLog->commit())
 	{
-		statusState = 4;
+		rawList->scrollToBottom();
 	}
 	
-	rawOut->setText("Raw output: "+readText);
-	statusOut->setText("Status: "+statusStrings[statusState]);
-		
 
 	//UI updating
-	SceneManager::instance()->update();
+	{
+		PerfScope scope(perfHud.frame.update);
+		TraceScope trace("SceneManager::update");
+		SceneManager::instance()->update();
+	}
 
-	if (SceneManager::instance()->getUISceneNode()->invalidated()) {
+	//the hud redraws for itself every few frames while it's up, otherwise an idle ui stays idle
+	bool drawn = SceneManager::instance()->getUISceneNode()->invalidated() || perfHud.tick();
+	if (drawn) {
 		win->clear();
-		SceneManager::instance()->draw();
-		win->display();
+		{
+			PerfScope scope(perfHud.frame.draw);
+			TraceScope trace("SceneManager::draw");
+			SceneManager::instance()->draw();
+			perfHud.draw(win->getWidth());
+		}
+		{
+			PerfScope scope(perfHud.frame.display);
+			TraceScope trace("win->display");
+			win->display();
+		}
+		if (bench.active() && bench.trace.sound && !bench.trace.shown)
+		{
+			bench.trace.shown = hostMicros();
+		}
 	} 
-	else {
-		win->getInput()->waitEvent( Milliseconds(win->hasFocus() ? 16 : 100));
+	perfHud.frame.total = hostMicros() - passStart;
+	perfHud.endFrame(drawn);
+	if (!drawn) {
+		win->getInput()->waitEvent( Milliseconds(waitMs()));
 	}
 }
 
@@ -192,7 +639,60 @@ void mainLoop() {
 
 
 
-EE_MAIN_FUNC int main(int, char**) {
+EE_MAIN_FUNC int main(int argc, char** argv) {
+	//JpController [--record file | --no-record] [--replay file [--speed N|max]] [--bench-latency trials file]
+	//             [--trace file] [--board file] [extra ports, like an emulator's pty]
+	std::string recordPath;
+	std::string boardPath;
+	bool record = true;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg=="--replay" && i+1<argc)
+		{
+			serialIO.replayPath = argv[++i];
+		}
+		else if (arg=="--speed" && i+1<argc)
+		{
+			arg = argv[++i];
+			serialIO.replaySpeed = arg=="max" ? 0 : std::max(atof(arg.c_str()), 0.001);
+		}
+		else if (arg=="--record" && i+1<argc)
+		{
+			recordPath = argv[++i];
+		}
+		else if (arg=="--no-record")
+		{
+			record = false;
+		}
+		else if (arg=="--bench-latency" && i+2<argc)
+		{
+			bench.trials = std::max(atoi(argv[++i]), 1);
+			bench.path = argv[++i];
+		}
+		else if (arg=="--board" && i+1<argc)
+		{
+			boardPath = argv[++i];
+		}
+		else if (arg=="--trace" && i+1<argc)
+		{
+			tracer().enable(argv[++i]);
+			traceThread("ui");
+		}
+		else if (arg[0]!='-' && isPortPath(arg))
+		{
+			extraPorts().push_back(arg);
+		}
+		else
+		{
+			std::cout<<"Unknown option or not a serial port: "<<arg<<"\n";
+			std::cout<<"usage: "<<argv[0]<<" [--record file | --no-record] [--replay file [--speed N|max]] [--bench-latency trials file]\n"
+					 <<"       [--trace file] [--board file] [extra ports under /dev or character devices, like an emulator's pty]\n";
+			return 1;
+		}
+	}
+	
+
 	win = Engine::instance()->createWindow(WindowSettings(1920, 1080, "Jeopardy controller"),
 											ContextSettings(true));
 
@@ -201,6 +701,7 @@ EE_MAIN_FUNC int main(int, char**) {
 		FileSystem::changeWorkingDirectory(Sys::getProcessPath());
 
 		FontTrueType* font = FontTrueType::New( "NotoSans-Regular", "assets/fonts/NotoSans-Regular.ttf" );
+		perfHud.init(font);
 
 		//scene node shenanigans
 		UISceneNode* uiSceneNode = UISceneNode::New();
@@ -226,45 +727,81 @@ EE_MAIN_FUNC int main(int, char**) {
 		});
 		
 		//status output thingies
-		rawOut = uiSceneNode->find<UITextView>("rawtitle");
 		statusOut = uiSceneNode->find<UITextView>("statustitle");
 		
+		//raw traffic console
+		rawList = uiSceneNode->find<UIListView>("rawlog");
+		rawList->setHeadersVisible(false);
+		rawList->setAutoExpandOnSingleColumn(true);
+		rawList->setModel(rawLog);
+		UICheckBox* rawHex = uiSceneNode->find<UICheckBox>("rawhex");
+		UICheckBox* rawKeepalive = uiSceneNode->find<UICheckBox>("rawkeepalive");
+		UICheckBox* rawPause = uiSceneNode->find<UICheckBox>("rawpause");
+		rawHex->setChecked(true);
+		rawHex->on(Event::OnValueChange, [rawHex](const Event*) {
+			rawLog->setHex(rawHex->isChecked());
+		});
+		rawKeepalive->on(Event::OnValueChange, [rawKeepalive](const Event*) {
+			rawLog->setKeepalive(rawKeepalive->isChecked());
+		});
+		rawPause->on(Event::OnValueChange, [rawPause](const Event*) {
+			rawLog->setPaused(rawPause->isChecked());
+		});
+		UITextInput* rawFilter = uiSceneNode->find<UITextInput>("rawfilter");
+		rawFilter->on(Event::OnTextChanged, [rawFilter](const Event*) {
+			rawLog->setFilter(rawFilter->getText().toUtf8());
+		});
+		
 		//button setups
 		//automatic storage duration setting thing ig
 		acceptButton = uiSceneNode->find<UIPushButton>("accept_answers");
 		stopAcceptButton = uiSceneNode->find<UIPushButton>("stop_accepting");
 		cancelButton = uiSceneNode->find<UIPushButton>("cancel_answer");
+		wrongButton = uiSceneNode->find<UIPushButton>("wrong_answer");
 		testButton = uiSceneNode->find<UIPushButton>("testmode");
 		rescanButton = uiSceneNode->find<UIPushButton>("rescan");
+		findButton = uiSceneNode->find<UIPushButton>("autodetect");
 		
 		acceptButton->onClick([](const MouseEvent*) {
-			acceptButton->setBackgroundColor(Color::lime);
-			sendSerial("accept");
+			sendSerial(CMD_ACCEPT);
 		}, EE_BUTTON_LEFT);
 		
 		stopAcceptButton->onClick([](const MouseEvent*) {
-			acceptButton->setBackgroundColor(Color::gray);
-			testButton->setBackgroundColor(Color::gray);
-			timeout.play();
-			sendSerial("stop");
+			sendSerial(CMD_STOP);
 		}, EE_BUTTON_LEFT);
 		
 		cancelButton->onClick([](const MouseEvent*) {
-			sendSerial("cancel");
+			sendSerial(CMD_CANCEL);
+		}, EE_BUTTON_LEFT);
+		
+		wrongButton->onClick([](const MouseEvent*) {
+			sendSerial(CMD_WRONG);
 		}, EE_BUTTON_LEFT);
 		
 		testButton->onClick([](const MouseEvent*) {
-			testButton->setBackgroundColor(Color::lime);
-			sendSerial("test");
+			sendSerial(CMD_TEST);
 		}, EE_BUTTON_LEFT);
 		rescanButton->onClick([](const MouseEvent*) {
 			portSelector->getListBox()->clear();
 			portSelector->getListBox()->addListBoxItems(getPorts());
 		}, EE_BUTTON_LEFT);
+		findButton->onClick([](const MouseEvent*) {
+			setStatus(9);
+			serialIO.probe();
+		}, EE_BUTTON_LEFT);
 		
 		
 		
 		
+		if (!boardPath.empty())
+		{
+			if (!board.load(boardPath))
+			{
+				std::cout<<"Can't read "<<boardPath<<", the board has the default categories\n";
+			}
+			board.open(font, win);
+		}
+		
 		answerBuf.loadFromFile("assets/sounds/answer.ogg");
 		answer.setBuffer(answerBuf);
 		
@@ -303,8 +840,52 @@ EE_MAIN_FUNC int main(int, char**) {
 			//MemoryManager::showResults();
 		});
 		
+		//every session is recorded unless it's a replay, see capture.hpp, --replay plays one back
+		if (record && serialIO.replayPath.empty())
+		{
+			if (recordPath.empty())
+			{
+				char name[64];
+				std::time_t now = std::time(NULL);
+				std::strftime(name, sizeof(name), "captures/%Y%m%d-%H%M%S.jpcap", std::localtime(&now));
+				std::error_code ec;
+				std::filesystem::create_directories("captures", ec);
+				recordPath = name;
+			}
+			if (serialIO.capture.open(recordPath))
+			{
+				std::cout<<"Recording to "<<recordPath<<"\n";
+			}
+			else
+			{
+				std::cout<<"Can't record to "<<recordPath<<"\n";
+			}
+		}
+		
 		//main loop
+		serialIO.onEvents = wakeMainLoop;
+		if (!WAKE_EVENTS)
+		{
+			std::cout<<"Built without SDL's headers, serial events are polled every 16 ms instead of waking the ui\n";
+		}
+		serialIO.start();
+		
+		//no guessing which port it is, every port gets asked at once
+		if (serialIO.replayPath.empty())
+		{
+			setStatus(9);
+			serialIO.probe();
+		}
+		else
+		{
+			std::cout<<"Replaying "<<serialIO.replayPath<<"\n";
+		}
 		win->runMainLoop(&mainLoop);
+		serialIO.stop();
+		if (tracer().enabled)
+		{
+			std::cout<<(tracer().write() ? "Trace written to " : "Can't write the trace to ")<<tracer().path<<"\n";
+		}
 	}
 	
 
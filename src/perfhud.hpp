@@ -0,0 +1,244 @@
+#ifndef JEOPARDY_PERFHUD_HPP
+#define JEOPARDY_PERFHUD_HPP
+
+#include <eepp/ee.hpp>
+#include <algorithm>
+#include <string>
+
+#include "clocksync.hpp"
+
+//performance overlay, F3 in JpController, drawn over the ui after SceneManager::draw()
+//mainLoop() times its stages with PerfScope into frame, endFrame() files it, the numbers are
+//only turned into text every PERF_REFRESH_MS so the overlay costs next to nothing while it's up
+#define PERF_HISTORY 240 //frames in the frame time graph
+#define PERF_BUZZES 64 //buzz to sound latencies in the sparkline and histogram
+#define PERF_BUCKETS 12 //histogram buckets, PERF_BUCKET_US wide, the last one takes everything above
+#define PERF_BUCKET_US 500
+#define PERF_REFRESH_MS 250
+
+//adds the micros until the end of the scope to a counter
+struct PerfScope {
+	Int64& total;
+	Int64 start;
+
+	PerfScope(Int64& total) : total(total), start(hostMicros()) {}
+
+	~PerfScope()
+	{
+		total += hostMicros() - start;
+	}
+};
+
+//one mainLoop() pass, micros
+struct PerfFrame {
+	Int64 serial = 0; //draining and handling serial events
+	Int64 update = 0; //SceneManager::update()
+	Int64 draw = 0; //SceneManager::draw() and this overlay
+	Int64 display = 0; //win->display()
+	Int64 total = 0; //the whole pass, not counting the wait for events
+	int events = 0; //serial events the pass drained, how far the queue had filled up
+};
+
+struct PerfHud {
+	bool visible = false;
+	bool dirty = false; //new numbers to show, or it was just toggled, mainLoop() redraws for it
+	PerfFrame frame; //the pass in progress
+
+	//only frames that were drawn, idle passes would drown them out
+	Int64 frameTimes[PERF_HISTORY] = {};
+	int frameCount = 0;
+
+	Int64 buzzes[PERF_BUZZES] = {};
+	int buzzCount = 0;
+
+	//since the last refresh
+	struct Totals {
+		int frames = 0;
+		Int64 serial = 0, update = 0, draw = 0, display = 0, total = 0;
+		Int64 updateMax = 0, drawMax = 0, totalMax = 0;
+		Uint64 bytes = 0, messages = 0;
+		Int64 parse = 0, parseMax = 0;
+		int depthMax = 0;
+	} window;
+	Int64 windowStart = 0;
+
+	Text* text = NULL;
+	Primitives primitives;
+
+	void init(Font* font)
+	{
+		text = Text::New(font, PixelDensity::dpToPx(18));
+		text->setFillColor(Color::White);
+		windowStart = hostMicros();
+	}
+
+	void toggle()
+	{
+		visible = !visible;
+		dirty = true;
+		frameCount = 0;
+		window = Totals();
+		windowStart = hostMicros();
+	}
+
+	//from the serial events as mainLoop() handles them
+	void addRead(size_t bytes)
+	{
+		window.bytes += bytes;
+	}
+
+	//read returned to frame decoded
+	void addMessage(Int64 parse)
+	{
+		window.messages++;
+		window.parse += parse;
+		window.parseMax = std::max(window.parseMax, parse);
+	}
+
+	//a clock sync that's off by more than the latency itself makes it negative, those aren't kept
+	void addBuzz(Int64 latency)
+	{
+		if (latency < 0)
+		{
+			return;
+		}
+		buzzes[buzzCount++ % PERF_BUZZES] = latency;
+	}
+
+	void endFrame(bool drawn)
+	{
+		window.depthMax = std::max(window.depthMax, frame.events);
+		if (drawn)
+		{
+			frameTimes[frameCount++ % PERF_HISTORY] = frame.total;
+			window.frames++;
+			window.serial += frame.serial;
+			window.update += frame.update;
+			window.draw += frame.draw;
+			window.display += frame.display;
+			window.total += frame.total;
+			window.updateMax = std::max(window.updateMax, frame.update);
+			window.drawMax = std::max(window.drawMax, frame.draw);
+			window.totalMax = std::max(window.totalMax, frame.total);
+		}
+		frame = PerfFrame();
+	}
+
+	//true when the overlay wants a redraw, its text is redone every PERF_REFRESH_MS while it's up
+	bool tick()
+	{
+		Int64 now = hostMicros();
+		if (visible && now - windowStart >= PERF_REFRESH_MS * 1000)
+		{
+			refresh(now);
+			dirty = true;
+		}
+		return dirty;
+	}
+
+	void refresh(Int64 now)
+	{
+		double seconds = (now - windowStart) / 1e6;
+		const Totals& w = window;
+		int frames = std::max(w.frames, 1);
+		std::string s = String::format("%.0f fps, frame %.2f ms avg %.2f max", w.frames / seconds, w.total / 1000.0 / frames, w.totalMax / 1000.0);
+		s += String::format("\nupdate %.2f ms avg %.2f max, draw %.2f / %.2f, display %.2f", w.update / 1000.0 / frames, w.updateMax / 1000.0,
+							w.draw / 1000.0 / frames, w.drawMax / 1000.0, w.display / 1000.0 / frames);
+		s += String::format("\nserial %.0f B/s, %.0f msg/s, events %.2f ms/frame, queue %d max", w.bytes / seconds, w.messages / seconds,
+							w.serial / 1000.0 / frames, w.depthMax);
+		s += String::format("\nparse %.0f us avg %lld max", w.messages ? (double)w.parse / w.messages : 0.0, (long long)w.parseMax);
+		int count = std::min(buzzCount, PERF_BUZZES);
+		if (count)
+		{
+			Int64 sorted[PERF_BUZZES];
+			std::copy(buzzes, buzzes + count, sorted);
+			std::sort(sorted, sorted + count);
+			s += String::format("\nbuzz to sound %.2f ms last, %.2f p50, %.2f max (%d)", buzzes[(buzzCount - 1) % PERF_BUZZES] / 1000.0,
+								sorted[count / 2] / 1000.0, sorted[count - 1] / 1000.0, count);
+		}
+		else
+		{
+			s += "\nbuzz to sound: no buzzes with a synced clock yet";
+		}
+		text->setString(s);
+		window = Totals();
+		windowStart = now;
+	}
+
+	void draw(Float width)
+	{
+		dirty = false;
+		if (!visible)
+		{
+			return;
+		}
+		Float pad = PixelDensity::dpToPx(10);
+		Float graphHeight = PixelDensity::dpToPx(60);
+		Float panelWidth = std::max(text->getTextWidth(), (Float)PERF_HISTORY * 2) + pad * 2;
+		Float left = width - panelWidth - pad;
+		Float top = pad;
+		Float textBottom = top + pad + text->getTextHeight();
+		Float bottom = textBottom + (graphHeight + pad) * 2 + pad;
+
+		primitives.setColor(Color(0, 0, 0, 200));
+		primitives.drawRectangle(Rectf(left, top, left + panelWidth, bottom));
+		text->draw(left + pad, top + pad);
+
+		//frame times, oldest to newest, a bar per frame and a line at 16.7 ms
+		Float graphLeft = left + pad;
+		Float graphBottom = textBottom + pad + graphHeight;
+		Float scale = graphHeight / 33333.0f;
+		int frames = std::min(frameCount, PERF_HISTORY);
+		for (int i = 0; i < frames; i++)
+		{
+			Int64 t = frameTimes[(frameCount - frames + i) % PERF_HISTORY];
+			primitives.setColor(t > 16667 ? Color::Red : Color::Green);
+			primitives.drawRectangle(Rectf(graphLeft + i * 2, graphBottom - std::min<Float>(t * scale, graphHeight), graphLeft + i * 2 + 1, graphBottom));
+		}
+		primitives.setColor(Color::Yellow);
+		primitives.drawLine(Line2f(Vector2f(graphLeft, graphBottom - 16667 * scale), Vector2f(graphLeft + PERF_HISTORY * 2, graphBottom - 16667 * scale)));
+
+		//buzz to sound, sparkline on the left, histogram on the right
+		int count = std::min(buzzCount, PERF_BUZZES);
+		if (!count)
+		{
+			return;
+		}
+		Float half = (panelWidth - pad * 3) / 2;
+		Float sparkBottom = graphBottom + pad + graphHeight;
+		Int64 highest = 1;
+		for (int i = 0; i < count; i++)
+		{
+			highest = std::max(highest, buzzes[i]);
+		}
+		primitives.setColor(Color::Teal);
+		Vector2f last;
+		for (int i = 0; i < count; i++)
+		{
+			Int64 t = buzzes[(buzzCount - count + i) % PERF_BUZZES];
+			Vector2f p(graphLeft + (count > 1 ? half * i / (count - 1) : 0), sparkBottom - graphHeight * t / highest);
+			if (i)
+			{
+				primitives.drawLine(Line2f(last, p));
+			}
+			last = p;
+		}
+
+		int buckets[PERF_BUCKETS] = {};
+		int tallest = 1;
+		for (int i = 0; i < count; i++)
+		{
+			int b = std::clamp<Int64>(buzzes[i] / PERF_BUCKET_US, 0, PERF_BUCKETS - 1);
+			tallest = std::max(tallest, ++buckets[b]);
+		}
+		Float histLeft = graphLeft + half + pad;
+		Float barWidth = half / PERF_BUCKETS;
+		for (int b = 0; b < PERF_BUCKETS; b++)
+		{
+			primitives.setColor(b == PERF_BUCKETS - 1 ? Color::Red : Color::Teal);
+			primitives.drawRectangle(Rectf(histLeft + b * barWidth, sparkBottom - graphHeight * buckets[b] / tallest, histLeft + (b + 1) * barWidth - 1, sparkBottom));
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef JEOPARDY_PORTS_HPP
+#define JEOPARDY_PORTS_HPP
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if EE_PLATFORM == EE_PLATFORM_LINUX
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
+//serial devices the controller can show up as, usb-serial adapters are ttyUSB*, the uno's own usb chip is ttyACM*
+inline bool isPortName(const std::string& name)
+{
+	return name.rfind("ttyUSB", 0) == 0 || name.rfind("ttyACM", 0) == 0;
+}
+
+//ports named on the command line, like the pty of the emulator (emu/jeopardyemu.cpp), listed and probed with
+//the real ones as long as they exist. set before the serial thread starts, only read after that
+inline std::vector<std::string>& extraPorts()
+{
+	static std::vector<std::string> ports;
+	return ports;
+}
+
+//what the command line takes as an extra port, anything under /dev or a character device (a symlink to a pty
+//counts), so a mistyped option isn't opened and probed as a serial port
+inline bool isPortPath(const std::string& path)
+{
+	std::error_code ec;
+	return path.rfind("/dev/", 0) == 0 || std::filesystem::is_character_file(path, ec);
+}
+
+inline std::vector<std::string> listPorts()
+{
+	std::vector<std::string> ports;
+	#if EE_PLATFORM == EE_PLATFORM_LINUX
+		std::error_code ec;
+		for (const auto& entry : std::filesystem::directory_iterator("/dev", ec))
+		{
+			if (isPortName(entry.path().filename().string()))
+			{
+				ports.push_back(entry.path().string());
+			}
+		}
+		std::sort(ports.begin(), ports.end());
+		for (const std::string& port : extraPorts())
+		{
+			if (std::filesystem::exists(port, ec) && std::find(ports.begin(), ports.end(), port) == ports.end())
+			{
+				ports.push_back(port);
+			}
+		}
+	#endif
+	return ports;
+}
+
+//usb vendor:product:serial of the device behind a tty, so the controller is recognised when it comes back under
+//a different name, empty if sysfs doesn't know (then only the same path counts as the same device)
+inline std::string portIdentity(const std::string& device)
+{
+	#if EE_PLATFORM == EE_PLATFORM_LINUX
+		std::error_code ec;
+		std::string name = std::filesystem::path(device).filename().string();
+		std::filesystem::path dir = std::filesystem::canonical("/sys/class/tty/" + name + "/device", ec);
+		for (int up = 0; !ec && up < 6 && dir.has_relative_path(); up++, dir = dir.parent_path())
+		{
+			if (std::filesystem::exists(dir / "idVendor", ec))
+			{
+				auto read = [&](const char* file) {
+					std::string value;
+					std::ifstream in(dir / file);
+					std::getline(in, value);
+					return value;
+				};
+				return read("idVendor") + ":" + read("idProduct") + ":" + read("serial");
+			}
+		}
+	#endif
+	return "";
+}
+
+//keeps an eye on /dev, ports appearing, disappearing or getting their permissions set by udev
+//the fd goes into a poll() set, changed() says whether any of that happened to a serial port since the last call
+struct PortWatcher {
+	int fd = -1;
+
+	bool start()
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (fd >= 0 && inotify_add_watch(fd, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB) < 0)
+			{
+				stop();
+			}
+		#endif
+		return fd >= 0;
+	}
+
+	void stop()
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+		#endif
+		fd = -1;
+	}
+
+	bool changed()
+	{
+		bool ports = false;
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			alignas(inotify_event) char buf[4096];
+			ssize_t n;
+			while (fd >= 0 && (n = ::read(fd, buf, sizeof(buf))) > 0)
+			{
+				for (char* p = buf; p < buf + n; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+				{
+					inotify_event* event = (inotify_event*)p;
+					if (event->len && isPortName(event->name))
+					{
+						ports = true;
+					}
+				}
+			}
+		#endif
+		return ports;
+	}
+};
+
+#endif
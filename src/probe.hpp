@@ -0,0 +1,162 @@
+#ifndef JEOPARDY_PROBE_HPP
+#define JEOPARDY_PROBE_HPP
+
+#include <eepp/ee.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../arduino/jeopardy/protocol.h"
+#include "clocksync.hpp"
+#include "serialtuning.hpp"
+
+#if EE_PLATFORM == EE_PLATFORM_LINUX
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <termios.h>
+	#include <unistd.h>
+#endif
+
+#define PROBE_TIMEOUT_MS 2500 //opening the port resets an uno, this covers its bootloader
+#define PROBE_RETRY_MS 100 //identify requests sent before the sketch runs are lost, keep asking
+
+struct ProbeResult {
+	std::string device;
+	Int64 micros = 0; //from the start of the probe to the answer
+};
+
+//asks one port who's there until our firmware answers, the deadline passes or stop is set
+//plain posix instead of CppLinuxSerial, so HUPCL can be cleared: DTR stays up when the probe closes the port and
+//opening it again for real doesn't reset the board a second time, ports that turn out not to be it get their
+//settings back
+inline bool probePort(const std::string& device, Int64 deadline, const std::atomic<bool>& stop)
+{
+	bool found = false;
+	#if EE_PLATFORM == EE_PLATFORM_LINUX
+		int fd = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0)
+		{
+			return false;
+		}
+		termios original;
+		bool saved = tcgetattr(fd, &original) == 0;
+		if (saved)
+		{
+			termios tty = original;
+			cfmakeraw(&tty);
+			tty.c_cflag |= CLOCAL | CREAD;
+			tty.c_cflag &= ~(HUPCL | CRTSCTS);
+			tty.c_cc[VMIN] = 0;
+			tty.c_cc[VTIME] = 0;
+			tcsetattr(fd, TCSANOW, &tty);
+		}
+		setBaud(fd, PROTO_BAUD);
+
+		Uint8 frame[PROTO_MAX_FRAME];
+		Uint8 len = protoEncode(CMD_IDENTIFY, NULL, 0, frame);
+		ProtoDecoder decoder;
+		protoReset(&decoder);
+		Int64 nextSend = 0;
+		while (!found && !stop)
+		{
+			Int64 now = hostMicros();
+			if (now >= deadline)
+			{
+				break;
+			}
+			if (now >= nextSend)
+			{
+				if (::write(fd, frame, len) < 0 && errno != EAGAIN)
+				{
+					break;
+				}
+				nextSend = now + PROBE_RETRY_MS * 1000;
+			}
+			pollfd pfd = {fd, POLLIN, 0};
+			if (::poll(&pfd, 1, (std::min(deadline, nextSend) - now + 999) / 1000) < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+			{
+				break;
+			}
+			Uint8 buf[64];
+			ssize_t n;
+			while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+			{
+				for (ssize_t i = 0; i < n; i++)
+				{
+					const ProtoMessage* msg = protoFeed(&decoder, buf[i]);
+					if (msg && msg->opcode == MSG_IDENTITY && msg->len >= 5 && memcmp(msg->payload, PROTO_SIGNATURE, 4) == 0)
+					{
+						if (msg->payload[4] == PROTO_VERSION)
+						{
+							found = true;
+						}
+						else
+						{
+							std::cout<<"Controller on "<<device<<" speaks protocol version "<<(int)msg->payload[4]<<", this needs "<<PROTO_VERSION<<"\n";
+						}
+					}
+				}
+			}
+		}
+		//only the controller keeps HUPCL cleared, anything else is left the way it was found
+		if (!found && saved)
+		{
+			tcsetattr(fd, TCSANOW, &original);
+		}
+		::close(fd);
+	#endif
+	return found;
+}
+
+//what the probe threads share with probePorts(), it outlives the call when the losers are still finishing up
+struct ProbeState {
+	std::mutex mutex;
+	std::condition_variable finished; //a probe ended, with or without an answer
+	ProbeResult result;
+	size_t left = 0; //probes still running
+	std::atomic<bool> stop{false}; //a port answered or the serial thread is shutting down
+};
+
+//probes every port at once, one thread each, and returns the first one our firmware answered on
+//that's as soon as it answers, the other probes are left to see stop and close their ports on their own
+//with nobody answering it takes one PROBE_TIMEOUT_MS, however many ports there are
+inline ProbeResult probePorts(const std::vector<std::string>& ports, const std::atomic<bool>& running)
+{
+	std::shared_ptr<ProbeState> state = std::make_shared<ProbeState>();
+	state->left = ports.size();
+	Int64 start = hostMicros();
+	Int64 deadline = start + PROBE_TIMEOUT_MS * 1000;
+
+	for (const std::string& port : ports)
+	{
+		std::thread([state, port, start, deadline]() {
+			bool found = probePort(port, deadline, state->stop); //the port is closed again by the time it's reported
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (found && state->result.device.empty())
+			{
+				state->result.device = port;
+				state->result.micros = hostMicros() - start;
+				state->stop = true;
+			}
+			state->left--;
+			state->finished.notify_all();
+		}).detach();
+	}
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	while (state->left && state->result.device.empty() && running)
+	{
+		state->finished.wait_for(lock, std::chrono::milliseconds(PROBE_RETRY_MS)); //running has no one to notify about it
+	}
+	state->stop = true;
+	return state->result;
+}
+
+#endif
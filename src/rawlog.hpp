@@ -0,0 +1,324 @@
+#ifndef JEOPARDY_RAWLOG_HPP
+#define JEOPARDY_RAWLOG_HPP
+
+#include <eepp/ee.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../arduino/jeopardy/protocol.h"
+#include "serialio.hpp"
+
+using namespace EE::UI::Models;
+
+//raw traffic console, the last RAWLOG_LINES reads and frames in a ring behind a UIListView
+//the list only asks for the rows it has on screen, so a line costs a copy into the ring and nothing gets laid out
+//until it's scrolled to, the view is told about new lines once per frame no matter how many came in
+#define RAWLOG_LINES 65536
+#define RAWLOG_FILTER_MS 150 //the filter is applied once typing stops this long, not on every key
+
+#define RAWLOG_READ 0 //bytes off the wire, one RAW event
+#define RAWLOG_MESSAGE 1 //a decoded frame
+
+static_assert(PROTO_MAX_PAYLOAD <= SERIAL_RAW_CHUNK, "a frame's payload has to fit a raw log line");
+
+struct RawLine {
+	Int64 time; //hostMicros() of the read
+	Uint8 kind;
+	Uint8 opcode; //RAWLOG_MESSAGE
+	Uint8 len;
+	bool keepalive; //heartbeats and pongs, hidden unless asked for
+	Uint8 data[SERIAL_RAW_CHUNK];
+};
+
+class RawLogModel : public Model {
+  public:
+	static std::shared_ptr<RawLogModel> New()
+	{
+		return std::shared_ptr<RawLogModel>(new RawLogModel());
+	}
+
+	Int64 start = 0; //times are shown relative to this, the first line if 0
+
+	void add(const SerialEvent& event)
+	{
+		RawLine& line = lines[added % RAWLOG_LINES];
+		line.time = event.time;
+		if (event.type == SerialEvent::MESSAGE)
+		{
+			line.kind = RAWLOG_MESSAGE;
+			line.opcode = event.msg.opcode;
+			line.len = std::min<size_t>(event.msg.len, PROTO_MAX_PAYLOAD);
+			line.keepalive = event.msg.opcode == MSG_HEARTBEAT || event.msg.opcode == MSG_PONG;
+			memcpy(line.data, event.msg.payload, line.len);
+		}
+		else
+		{
+			line.kind = RAWLOG_READ;
+			line.opcode = 0;
+			line.len = event.rawLen;
+			line.keepalive = event.keepalive;
+			memcpy(line.data, event.raw, line.len);
+		}
+		if (!start)
+		{
+			start = line.time;
+		}
+		added++;
+	}
+
+	//once per frame, filters whatever came in since the last call into the shown rows
+	//true if the rows changed, the view has been told then
+	bool commit()
+	{
+		if (filterPending && hostMicros() >= filterAt)
+		{
+			filterPending = false;
+			applyFilter();
+		}
+		if (paused)
+		{
+			return false;
+		}
+		bool changed = false;
+		Uint64 oldest = added - std::min<Uint64>(added, RAWLOG_LINES);
+		while (!rows.empty() && rows.front() < oldest)
+		{
+			rows.pop_front();
+			changed = true;
+		}
+		for (Uint64 n = std::max(scanned, oldest); n < added; n++)
+		{
+			if (passes(lines[n % RAWLOG_LINES]))
+			{
+				rows.push_back(n);
+				changed = true;
+			}
+		}
+		scanned = added;
+		if (changed)
+		{
+			onModelUpdate(UpdateFlag::DontInvalidateIndexes);
+		}
+		return changed;
+	}
+
+	//hex shows the reads as they came, decoded the frames in them
+	void setHex(bool on)
+	{
+		hex = on;
+		refilter();
+	}
+
+	void setKeepalive(bool on)
+	{
+		keepalive = on;
+		refilter();
+	}
+
+	//case insensitive, matched against the line as it's shown
+	//every line has to be formatted for it, so it waits for RAWLOG_FILTER_MS without a change and commit() applies it
+	void setFilter(const std::string& text)
+	{
+		pendingFilter = lower(text);
+		filterPending = true;
+		filterAt = hostMicros() + RAWLOG_FILTER_MS * 1000;
+	}
+
+	//the rows stay put while paused, lines keep going into the ring and show up on resume
+	void setPaused(bool on)
+	{
+		paused = on;
+		commit();
+	}
+
+	bool isPaused() const
+	{
+		return paused;
+	}
+
+	size_t rowCount(const ModelIndex& = ModelIndex()) const override
+	{
+		return rows.size();
+	}
+
+	size_t columnCount(const ModelIndex& = ModelIndex()) const override
+	{
+		return 1;
+	}
+
+	Variant data(const ModelIndex& index, ModelRole role = ModelRole::Display) const override
+	{
+		if (role != ModelRole::Display || index.row() < 0 || (size_t)index.row() >= rows.size())
+		{
+			return {};
+		}
+		Uint64 n = rows[index.row()];
+		if (n + RAWLOG_LINES < added) //paused long enough for the ring to come around
+		{
+			return Variant(std::string("(overwritten)"));
+		}
+		return Variant(format(lines[n % RAWLOG_LINES]));
+	}
+
+	std::string format(const RawLine& line) const
+	{
+		char text[256];
+		int n = snprintf(text, sizeof(text), "%10.6f  ", (line.time - start) / 1e6);
+		if (line.kind == RAWLOG_READ)
+		{
+			static const char digits[] = "0123456789ABCDEF";
+			for (int i = 0; i < line.len; i++)
+			{
+				text[n++] = digits[line.data[i] >> 4];
+				text[n++] = digits[line.data[i] & 0xF];
+				text[n++] = ' ';
+			}
+			text[n] = 0;
+		}
+		else
+		{
+			decode(line, text + n, sizeof(text) - n);
+		}
+		return text;
+	}
+
+  protected:
+	std::vector<RawLine> lines = std::vector<RawLine>(RAWLOG_LINES);
+	Uint64 added = 0; //lines ever added, line n is lines[n % RAWLOG_LINES] until it's overwritten
+	Uint64 scanned = 0; //lines commit() has run through the filter
+	std::deque<Uint64> rows; //the lines that are shown
+	bool hex = true;
+	bool keepalive = false;
+	bool paused = false;
+	std::string filter;
+	std::string pendingFilter; //typed, not applied yet
+	bool filterPending = false;
+	Int64 filterAt = 0; //hostMicros() when it gets applied
+
+	RawLogModel() {}
+
+	static std::string lower(std::string text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+		return text;
+	}
+
+	bool passes(const RawLine& line) const
+	{
+		if (line.kind != (hex ? RAWLOG_READ : RAWLOG_MESSAGE) || (line.keepalive && !keepalive))
+		{
+			return false;
+		}
+		return matches(line);
+	}
+
+	bool matches(const RawLine& line) const
+	{
+		return filter.empty() || lower(format(line)).find(filter) != std::string::npos;
+	}
+
+	//a filter that contains the old one can only take rows away, only the shown rows are run through it then
+	void applyFilter()
+	{
+		std::string old = filter;
+		filter = pendingFilter;
+		if (filter == old)
+		{
+			return;
+		}
+		if (filter.find(old) == std::string::npos)
+		{
+			refilter();
+			return;
+		}
+		rows.erase(std::remove_if(rows.begin(), rows.end(), [this](Uint64 n) { return n + RAWLOG_LINES < added || !matches(lines[n % RAWLOG_LINES]); }), rows.end());
+		onModelUpdate(UpdateFlag::InvalidateAllIndexes);
+	}
+
+	//everything since the oldest line still in the ring, with the current settings
+	void refilter()
+	{
+		rows.clear();
+		scanned = 0;
+		bool wasPaused = paused;
+		paused = false;
+		commit();
+		paused = wasPaused;
+		onModelUpdate(UpdateFlag::InvalidateAllIndexes);
+	}
+
+	static const char* stateName(Uint8 state)
+	{
+		static const char* names[] = {"?", "idle", "accepting", "answering", "testing"};
+		return state <= STATE_TESTING ? names[state] : "?";
+	}
+
+	static void decode(const RawLine& line, char* text, size_t size)
+	{
+		const Uint8* p = line.data;
+		switch (line.opcode)
+		{
+			case MSG_STATE:
+			case MSG_HEARTBEAT:
+				if (line.len >= 1)
+				{
+					snprintf(text, size, "%s %s", line.opcode == MSG_STATE ? "STATE" : "HEARTBEAT", stateName(p[0]));
+					return;
+				}
+				break;
+			case MSG_BUZZ:
+				if (line.len >= 9)
+				{
+					snprintf(text, size, "BUZZ player %d after %.3f ms, press at %u", p[0] + 1, protoGetU32(p + 1) / 1000.0, (unsigned)protoGetU32(p + 5));
+					return;
+				}
+				break;
+			case MSG_PRESSES:
+				if (line.len >= 1 && line.len >= 1 + p[0] * 6)
+				{
+					int n = snprintf(text, size, "PRESSES %d", p[0]);
+					for (int i = 0; i < p[0] && n < (int)size; i++)
+					{
+						const Uint8* entry = p + 1 + i * 6;
+						n += snprintf(text + n, size - n, ", player %d %.3f ms flags %X", entry[0] + 1, protoGetU32(entry + 2) / 1000.0, entry[1]);
+					}
+					return;
+				}
+				break;
+			case MSG_PONG:
+				if (line.len >= 8)
+				{
+					snprintf(text, size, "PONG tag %08X at %u", (unsigned)protoGetU32(p), (unsigned)protoGetU32(p + 4));
+					return;
+				}
+				break;
+			case MSG_IDENTITY:
+				if (line.len >= 1)
+				{
+					snprintf(text, size, "IDENTITY version %d", p[line.len - 1]);
+					return;
+				}
+				break;
+			case MSG_ACK:
+				if (line.len >= 4)
+				{
+					snprintf(text, size, "ACK #%d %02X, %s -> %s", p[0], p[1], stateName(p[3]), stateName(p[2]));
+					return;
+				}
+				break;
+		}
+		//unknown or short, opcode and payload as they are
+		int n = snprintf(text, size, "%02X:", line.opcode);
+		for (int i = 0; i < line.len && n + 3 < (int)size; i++)
+		{
+			n += snprintf(text + n, size - n, " %02X", p[i]);
+		}
+	}
+};
+
+#endif
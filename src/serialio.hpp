@@ -0,0 +1,881 @@
+#ifndef JEOPARDY_SERIALIO_HPP
+#define JEOPARDY_SERIALIO_HPP
+
+#include <eepp/ee.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "../arduino/jeopardy/protocol.h"
+#include "capture.hpp"
+#include "clocksync.hpp"
+#include "ports.hpp"
+#include "probe.hpp"
+#include "serialtuning.hpp"
+#include "spscring.hpp"
+#include "trace.hpp"
+
+#if EE_PLATFORM == EE_PLATFORM_LINUX
+	#include <CppLinuxSerial/SerialPort.hpp>
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <sys/eventfd.h>
+	#include <unistd.h>
+#endif
+
+#define PING_MS 250 //clock sync ping period
+#define RECONNECT_MS 100 //retry period for a lost port, on top of retrying whenever /dev changes
+#define SERIAL_RAW_CHUNK 32 //raw bytes per RAW event, longer reads are split
+#define ACK_TIMEOUT_MS 30 //retransmit timeout until there are round trips to go by
+#define ACK_MIN_TIMEOUT_MS 10 //a loop() pass that pushes out two led frames holds a command up for ~7ms
+#define ACK_MAX_TIMEOUT_MS 200
+#define ACK_MAX_TRIES 5 //then the command is given up on, the ui hears about it
+
+//serial thread -> ui thread
+struct SerialEvent {
+	enum Type : Uint8 {
+		MESSAGE, //a complete frame, time is when the read it finished in returned
+		RAW, //bytes as they came off the wire, for the raw view, after the messages in them
+		OPENED, //raw holds the device path
+		LOST, //the port failed to open
+		RECONNECTING, //the open port went away, it's reopened as soon as it's back
+		PORTS, //serial ports came or went
+		NOT_FOUND, //a probe ended without any port answering
+		ACKED, //a game command got its MSG_ACK, msg is the ack (it also comes as a MESSAGE)
+		FAILED //a game command was given up on, msg.opcode is the command
+	};
+	Uint8 type;
+	Uint8 rawLen;
+	Uint8 tries; //ACKED and FAILED, how often the command went out
+	bool keepalive; //RAW, the read was nothing but whole heartbeat and pong frames, the line is just idling
+	Int64 time; //hostMicros()
+	Int64 latency; //ACKED, micros from the ui queueing the command to its ack
+	Int64 parsed; //MESSAGE, hostMicros() when it came out of the decoder (the read time in a replay)
+	ProtoMessage msg;
+	Uint8 raw[SERIAL_RAW_CHUNK];
+};
+
+//ui thread -> serial thread
+struct SerialCommand {
+	enum Type : Uint8 {
+		SEND,
+		SEND_ACKED, //game command, gets a seq and goes out again until it's acked
+		OPEN,
+		CLOSE,
+		PROBE //find the controller among all ports and open it
+	};
+	Uint8 type;
+	Uint8 opcode;
+	Uint8 len;
+	Uint8 payload[PROTO_MAX_PAYLOAD];
+	Int64 time; //hostMicros() when the ui queued it
+	char device[128];
+};
+
+//a game command waiting for its MSG_ACK, only the oldest one is on the wire so they run in the order they were
+//clicked, at 1Mbaud an ack is back within a loop() pass so the queue is never more than a click or two long
+struct PendingCommand {
+	Uint8 seq;
+	Uint8 opcode;
+	Uint8 tries;
+	Int64 queued; //SerialCommand::time
+	Int64 sent; //last time it went out, 0 if it hasn't yet
+};
+
+//owns the serial port on its own thread, so a slow or quiet port never holds up a frame and a slow frame never
+//holds up the port. Everything the ui needs goes through the two rings, the ui drains events with poll() and
+//never blocks on the serial thread
+//the thread sleeps in poll() on the tty and an eventfd for commands, so it costs nothing while the line is quiet,
+//and it calls onEvents (once until the ui drains again) to wake the ui loop up when there is something new
+struct SerialIO {
+	SpscRing<SerialEvent, 1024> events;
+	SpscRing<SerialCommand, 64> commands;
+	std::atomic<bool> open{false};
+	std::atomic<Uint32> droppedEvents{0}; //events lost because the ui fell that far behind
+	std::atomic<Uint32> droppedCommands{0};
+
+	std::function<void()> onEvents; //called from the serial thread, must be thread safe
+	std::atomic<bool> uiNotified{false};
+
+	std::atomic<bool> running{false};
+	std::thread thread;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+
+	#if EE_PLATFORM == EE_PLATFORM_LINUX
+		mn::CppLinuxSerial::SerialPort port;
+		int readyFd = -1; //the same tty opened again, only to poll() it, CppLinuxSerial keeps its own fd to itself
+		int wakeFd = -1;
+	#endif
+	PortWatcher watcher;
+	std::string device; //last port that opened
+	std::string identity; //and the usb device behind it
+	bool reconnecting = false;
+	Int64 nextRetry = 0;
+	std::mutex tuningMutex;
+	std::string tuningReport; //settings the driver actually took for the open port
+	ProtoDecoder decoder;
+	std::vector<Uint8> readBuffer; //reused, reads don't allocate once it has grown
+	Int64 lastPing = 0;
+	std::deque<PendingCommand> pending;
+	Uint8 seq = std::max<Uint8>(1, (Uint8)hostMicros()); //a restarted host doesn't start on the seq the controller last saw, and 0 is never used
+	double rtt = 0; //smoothed round trip of first tries and its mean deviation, micros, like tcp's
+	double rttVar = 0;
+	CaptureWriter capture; //open it before start(), the serial thread owns it after that
+	std::string replayPath; //set before start() to play a capture instead of opening ports
+	double replaySpeed = 1; //0 for as fast as the ui takes it
+
+	void start()
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		#endif
+		if (replayPath.empty() && !watcher.start())
+		{
+			std::cout<<"Can't watch /dev, the port list only updates on a rescan\n";
+		}
+		running = true;
+		thread = std::thread([this]() { run(); });
+	}
+
+	//closes the port and joins, call before the window goes away
+	void stop()
+	{
+		if (!running)
+		{
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			running = false;
+		}
+		wakeThread();
+		thread.join();
+		watcher.stop();
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			if (wakeFd >= 0)
+			{
+				::close(wakeFd);
+				wakeFd = -1;
+			}
+		#endif
+	}
+
+	//ui thread side, call before draining so anything published after that wakes the ui again
+	void drained()
+	{
+		uiNotified = false;
+	}
+
+	bool poll(SerialEvent& event)
+	{
+		return events.pop(event);
+	}
+
+	std::string tuning()
+	{
+		std::lock_guard<std::mutex> lock(tuningMutex);
+		return tuningReport;
+	}
+
+	void send(Uint8 opcode, const Uint8* payload = NULL, Uint8 len = 0)
+	{
+		SerialCommand cmd;
+		cmd.type = SerialCommand::SEND;
+		cmd.opcode = opcode;
+		cmd.len = std::min<Uint8>(len, PROTO_MAX_PAYLOAD);
+		if (payload)
+		{
+			memcpy(cmd.payload, payload, cmd.len);
+		}
+		command(cmd);
+	}
+
+	//a game command, see PendingCommand, the ui gets an ACKED or FAILED event for it
+	void sendAcked(Uint8 opcode)
+	{
+		SerialCommand cmd;
+		cmd.type = SerialCommand::SEND_ACKED;
+		cmd.opcode = opcode;
+		cmd.len = 0;
+		cmd.time = hostMicros();
+		command(cmd);
+	}
+
+	void openPort(const std::string& device)
+	{
+		SerialCommand cmd;
+		cmd.type = SerialCommand::OPEN;
+		strncpy(cmd.device, device.c_str(), sizeof(cmd.device) - 1);
+		cmd.device[sizeof(cmd.device) - 1] = 0;
+		command(cmd);
+	}
+
+	void closePort()
+	{
+		SerialCommand cmd;
+		cmd.type = SerialCommand::CLOSE;
+		command(cmd);
+	}
+
+	void probe()
+	{
+		SerialCommand cmd;
+		cmd.type = SerialCommand::PROBE;
+		command(cmd);
+	}
+
+	void command(const SerialCommand& cmd)
+	{
+		if (!commands.push(cmd))
+		{
+			droppedCommands++;
+			return;
+		}
+		wakeThread();
+	}
+
+	void wakeThread()
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			if (wakeFd >= 0)
+			{
+				Uint64 one = 1;
+				if (::write(wakeFd, &one, sizeof(one)) < 0) {} //only fails if the counter is already huge, the thread is awake then
+				return;
+			}
+		#endif
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex); //so the notify can't slip in before the thread waits
+		}
+		wake.notify_one();
+	}
+
+	void notifyUi()
+	{
+		if (onEvents && !uiNotified.exchange(true))
+		{
+			onEvents();
+		}
+	}
+
+	//serial thread side
+	//a replay waits for the ui instead of dropping, it's supposed to come out exactly as it went in
+	void publish(const SerialEvent& event)
+	{
+		while (!events.push(event))
+		{
+			if (replayPath.empty() || !running)
+			{
+				droppedEvents++;
+				return;
+			}
+			notifyUi();
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+
+	void publish(Uint8 type)
+	{
+		SerialEvent event;
+		event.type = type;
+		event.rawLen = 0;
+		event.tries = 0;
+		event.time = hostMicros();
+		publish(event);
+	}
+
+	#if EE_PLATFORM == EE_PLATFORM_LINUX
+	bool isOpen()
+	{
+		return port.GetState() == mn::CppLinuxSerial::State::OPEN;
+	}
+
+	void failed(const PendingCommand& cmd)
+	{
+		SerialEvent event;
+		event.type = SerialEvent::FAILED;
+		event.rawLen = 0;
+		event.tries = cmd.tries;
+		event.time = hostMicros();
+		event.msg.opcode = cmd.opcode;
+		event.msg.len = 0;
+		publish(event);
+	}
+
+	//commands still waiting when the port goes away are dropped, not sent to whatever it reconnects to later
+	void failPending()
+	{
+		for (const PendingCommand& cmd : pending)
+		{
+			failed(cmd);
+		}
+		if (!pending.empty())
+		{
+			pending.clear();
+			notifyUi();
+		}
+	}
+
+	void closeNow()
+	{
+		failPending();
+		if (readyFd >= 0)
+		{
+			::close(readyFd);
+			readyFd = -1;
+		}
+		try
+		{
+			if (isOpen())
+			{
+				port.Close();
+			}
+		}
+		catch (const std::system_error&)
+		{
+		}
+		open = false;
+	}
+
+	//a port that was working is watched for and reopened when it comes back, one that never opened isn't
+	void lost(const char* what)
+	{
+		capture.add(CAPTURE_LOST, NULL, 0, hostMicros());
+		std::cout<<what<<", port disconnected?\n";
+		std::cout<<"Attempting to close port\n";
+		closeNow();
+		reconnecting = !device.empty();
+		nextRetry = hostMicros() + RECONNECT_MS * 1000;
+		if (reconnecting)
+		{
+			std::cout<<"Waiting for "<<device<<" to come back\n";
+		}
+		publish(reconnecting ? SerialEvent::RECONNECTING : SerialEvent::LOST);
+		notifyUi();
+	}
+
+	//false and closed if it didn't open
+	bool openDevice(const std::string& dev)
+	{
+		closeNow();
+		try
+		{
+			port.SetBaudRate((uint32_t)PROTO_BAUD);
+			port.SetTimeout(0); //never block, the thread waits on its own terms
+			port.SetDevice(dev);
+			port.Open();
+		}
+		catch (const std::system_error&)
+		{
+			closeNow();
+			return false;
+		}
+		readyFd = ::open(dev.c_str(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+		if (readyFd >= 0)
+		{
+			lowLatency(dev);
+		}
+		protoReset(&decoder);
+		readBuffer.reserve(256); //CppLinuxSerial reads at most 255 bytes at a time
+		lastPing = 0;
+		rtt = 0;
+		open = true;
+		device = dev;
+		Int64 now = hostMicros();
+		capture.add(CAPTURE_OPENED, (const Uint8*)dev.data(), dev.size(), now);
+		opened(dev, now);
+		write(CMD_IDENTIFY, NULL, 0); //the controller forgets the seq it saw last, this host's first command can't look like a repeat
+		return true;
+	}
+
+	//raw mode with VMIN 0 VTIME 0: reads never wait and never hold bytes back, poll() on readyFd does the waiting
+	//then the baud rate through termios2 so rates without a B constant work, and the driver's low latency bits
+	void lowLatency(const std::string& dev)
+	{
+		termios tty;
+		if (tcgetattr(readyFd, &tty) == 0)
+		{
+			cfmakeraw(&tty);
+			tty.c_cflag |= CLOCAL | CREAD;
+			tty.c_cc[VMIN] = 0;
+			tty.c_cc[VTIME] = 0;
+			tcsetattr(readyFd, TCSANOW, &tty);
+		}
+		setBaud(readyFd, PROTO_BAUD);
+		SerialTuning tuning = tunePort(readyFd, dev);
+		std::cout<<"Serial settings on "<<dev<<": "<<tuning.describe()<<"\n";
+		if (tuning.baud != PROTO_BAUD)
+		{
+			std::cout<<"The driver didn't take "<<PROTO_BAUD<<" baud, the controller won't be understood\n";
+		}
+		std::lock_guard<std::mutex> lock(tuningMutex);
+		tuningReport = tuning.describe();
+	}
+
+	//the lost controller is back once a port with its usb identity (or its old path, if there is none) opens
+	//it can come back under another name, a glitch can leave the old ttyACM0 busy and turn up as ttyACM1
+	void tryReconnect()
+	{
+		for (const std::string& candidate : listPorts())
+		{
+			if ((identity.empty() ? candidate == device : portIdentity(candidate) == identity) && openDevice(candidate))
+			{
+				reconnecting = false;
+				identity = portIdentity(candidate);
+				std::cout<<"Reconnected to "<<candidate<<"\n";
+				return;
+			}
+		}
+	}
+
+	void write(Uint8 opcode, const Uint8* payload, Uint8 len)
+	{
+		Uint8 frame[PROTO_MAX_FRAME];
+		TraceScope trace("write", opcode);
+		Uint8 n = protoEncode(opcode, payload, len, frame);
+		capture.add(CAPTURE_WRITE, frame, n, hostMicros());
+		try
+		{
+			port.Write(std::string((const char*)frame, n));
+		}
+		catch (const std::system_error&)
+		{
+			lost("Serial write failed");
+		}
+	}
+
+	void execute(const SerialCommand& cmd)
+	{
+		switch (cmd.type)
+		{
+			case SerialCommand::SEND:
+				if (isOpen())
+				{
+					write(cmd.opcode, cmd.payload, cmd.len);
+				}
+				break;
+			case SerialCommand::SEND_ACKED:
+				seq = seq == 255 ? 1 : seq + 1;
+				pending.push_back({seq, cmd.opcode, 0, cmd.time, 0});
+				if (!isOpen())
+				{
+					failPending();
+				}
+				sendPending();
+				break;
+			case SerialCommand::OPEN:
+				reconnecting = false;
+				device.clear();
+				if (openDevice(cmd.device))
+				{
+					identity = portIdentity(cmd.device);
+				}
+				else
+				{
+					lost("Couldn't open the serial port");
+				}
+				break;
+			case SerialCommand::CLOSE:
+				reconnecting = false;
+				device.clear();
+				closeNow();
+				break;
+			case SerialCommand::PROBE:
+			{
+				reconnecting = false;
+				device.clear();
+				closeNow();
+				std::vector<std::string> ports = listPorts();
+				ProbeResult found = probePorts(ports, running);
+				if (found.device.empty())
+				{
+					std::cout<<"No controller answered on "<<ports.size()<<" ports\n";
+					publish(SerialEvent::NOT_FOUND);
+					notifyUi();
+				}
+				else if (openDevice(found.device))
+				{
+					std::cout<<"Controller found on "<<found.device<<" after "<<found.micros/1000<<" ms\n";
+					identity = portIdentity(found.device);
+				}
+				else
+				{
+					lost("Couldn't open the serial port");
+				}
+				break;
+			}
+		}
+	}
+
+	//one read, every complete frame in it goes out as its own event in order, partial ones carry over
+	bool readPort()
+	{
+		std::vector<Uint8>& data = readBuffer;
+		data.clear();
+		Int64 readStart = hostMicros();
+		try
+		{
+			port.ReadBinary(data);
+		}
+		catch (const std::system_error&)
+		{
+			lost("Serial port address is bad");
+			return false;
+		}
+		if (data.empty())
+		{
+			return false;
+		}
+		Int64 now = hostMicros();
+		traceEvent("read", 'X', readStart, now - readStart, data.size()); //only the ones that got something
+		capture.add(CAPTURE_READ, data.data(), data.size(), now);
+		received(data.data(), data.size(), now);
+		return true;
+	}
+
+	void opened(const std::string& dev, Int64 time)
+	{
+		SerialEvent event;
+		event.type = SerialEvent::OPENED;
+		event.tries = 0;
+		event.time = time;
+		event.rawLen = std::min<size_t>(dev.size(), SERIAL_RAW_CHUNK);
+		memcpy(event.raw, dev.data(), event.rawLen);
+		publish(event);
+		notifyUi();
+	}
+
+	//bytes off the port, now is the hostMicros() of the read they came in
+	void received(const Uint8* data, size_t size, Int64 now)
+	{
+		//parsed in place, the only copy of a message is the one into the ring
+		TraceScope trace("parse", size);
+		SerialEvent event;
+		event.type = SerialEvent::MESSAGE;
+		event.rawLen = 0;
+		event.tries = 0;
+		event.time = now;
+		size_t keepaliveBytes = 0; //whole heartbeat and pong frames in the read, see SerialEvent::keepalive
+		const Uint8* p = data;
+		size_t left = size;
+		while (left)
+		{
+			Uint16 used;
+			const ProtoMessage* msg = protoParse(&decoder, p, std::min<size_t>(left, 0xFFFF), &used);
+			p += used;
+			left -= used;
+			if (msg)
+			{
+				event.msg = *msg;
+				event.parsed = replayPath.empty() ? hostMicros() : now;
+				if (msg->opcode == MSG_BUZZ)
+				{
+					traceInstant("buzz frame", msg->payload[0]);
+				}
+				publish(event);
+				if (msg->opcode == MSG_ACK && msg->len >= 4)
+				{
+					acked(event);
+				}
+				if (msg->opcode == MSG_HEARTBEAT || msg->opcode == MSG_PONG)
+				{
+					Uint8 frame[PROTO_MAX_FRAME];
+					keepaliveBytes += protoEncode(msg->opcode, msg->payload, msg->len, frame);
+				}
+			}
+		}
+
+		event.type = SerialEvent::RAW;
+		event.keepalive = keepaliveBytes == size; //anything else, a partial frame or junk included, makes it count
+		for (size_t i = 0; i < size; i += SERIAL_RAW_CHUNK)
+		{
+			event.rawLen = std::min<size_t>(SERIAL_RAW_CHUNK, size - i);
+			memcpy(event.raw, data + i, event.rawLen);
+			publish(event);
+		}
+	}
+
+	//retransmit timeout from the measured round trips, the same formula tcp uses
+	Int64 ackTimeout()
+	{
+		if (rtt <= 0)
+		{
+			return ACK_TIMEOUT_MS * 1000;
+		}
+		return std::clamp<Int64>(rtt + 4 * rttVar, ACK_MIN_TIMEOUT_MS * 1000, ACK_MAX_TIMEOUT_MS * 1000);
+	}
+
+	//an ack for anything but the command on the wire is a late one for a retry, nothing to do
+	void acked(SerialEvent event)
+	{
+		if (pending.empty() || event.msg.payload[0] != pending.front().seq || event.msg.payload[1] != pending.front().opcode)
+		{
+			return;
+		}
+		const PendingCommand& cmd = pending.front();
+		if (cmd.tries == 1) //a retried command's ack can't tell which try it answers
+		{
+			double sample = event.time - cmd.sent;
+			if (rtt <= 0)
+			{
+				rtt = sample;
+				rttVar = sample / 2;
+			}
+			else
+			{
+				rttVar += (std::abs(sample - rtt) - rttVar) / 4;
+				rtt += (sample - rtt) / 8;
+			}
+		}
+		event.type = SerialEvent::ACKED;
+		event.tries = cmd.tries;
+		event.latency = event.time - cmd.queued;
+		publish(event);
+		pending.pop_front();
+		sendPending();
+	}
+
+	//sends the oldest command if it's new or its ack is overdue, returns the ms until it's overdue (-1 for none)
+	int sendPending()
+	{
+		while (!pending.empty())
+		{
+			PendingCommand& cmd = pending.front();
+			Int64 now = hostMicros();
+			Int64 due = cmd.sent + ackTimeout();
+			if (cmd.sent && now < due)
+			{
+				return (due - now + 999) / 1000;
+			}
+			if (cmd.tries == ACK_MAX_TRIES)
+			{
+				failed(cmd);
+				notifyUi();
+				pending.pop_front();
+				continue;
+			}
+			cmd.tries++;
+			cmd.sent = now;
+			write(cmd.opcode, &cmd.seq, 1);
+		}
+		return -1;
+	}
+
+	//sends a ping when one is due, returns the ms until the next one
+	int ping()
+	{
+		Int64 now = hostMicros();
+		if (now - lastPing >= PING_MS * 1000)
+		{
+			lastPing = now;
+			Uint8 tag[4];
+			protoPutU32(tag, (Uint32)now);
+			write(CMD_PING, tag, 4);
+		}
+		return (lastPing + PING_MS * 1000 - now + 999) / 1000;
+	}
+	#endif
+
+	//sleeps until the tty has data, a command comes in or timeoutMs is up (-1 for no timeout)
+	void waitForWork(int timeoutMs)
+	{
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			if (wakeFd >= 0)
+			{
+				pollfd fds[3] = {{wakeFd, POLLIN, 0}, {watcher.fd, POLLIN, 0}, {readyFd, POLLIN, 0}};
+				bool tty = readyFd >= 0;
+				if (open && !tty)
+				{
+					timeoutMs = 1; //couldn't open the tty a second time, fall back to polling it
+				}
+				if (::poll(fds, tty ? 3 : 2, timeoutMs) <= 0) //a negative fd (no watcher) is skipped
+				{
+					return;
+				}
+				if (fds[0].revents & POLLIN)
+				{
+					Uint64 count;
+					if (::read(wakeFd, &count, sizeof(count)) < 0) {}
+				}
+				if (tty && (fds[2].revents & (POLLHUP | POLLERR | POLLNVAL)))
+				{
+					lost("Serial port hung up");
+				}
+				return;
+			}
+		#endif
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wake.wait_for(lock, std::chrono::milliseconds(open ? 1 : 100), [this]() { return !running || !commands.empty(); });
+	}
+
+	#if EE_PLATFORM == EE_PLATFORM_LINUX
+	//nothing goes out during a replay, game commands fail right away like they do with no port
+	void discardCommands()
+	{
+		SerialCommand cmd;
+		while (commands.pop(cmd))
+		{
+			if (cmd.type == SerialCommand::SEND_ACKED)
+			{
+				failed({0, cmd.opcode, 0, cmd.time, 0});
+				notifyUi();
+			}
+		}
+	}
+
+	//plays a capture into the same path reads take, at replaySpeed times the speed it was recorded at
+	//events keep the times they were recorded with, so clock sync and everything timed works out the same
+	void replay()
+	{
+		CaptureReader reader;
+		if (!reader.open(replayPath))
+		{
+			std::cout<<"Can't replay "<<replayPath<<", not a capture\n";
+			publish(SerialEvent::LOST);
+			notifyUi();
+		}
+		else
+		{
+			if (reader.protocol() != PROTO_VERSION)
+			{
+				std::cout<<replayPath<<" was recorded with protocol version "<<(int)reader.protocol()<<", this speaks "<<PROTO_VERSION<<"\n";
+			}
+			Int64 start = hostMicros();
+			Int64 first = -1;
+			Int64 last = 0;
+			Uint64 reads = 0;
+			Uint64 bytes = 0;
+			CaptureRecord record;
+			while (running && reader.next(record))
+			{
+				if (first < 0)
+				{
+					first = record.time;
+				}
+				last = record.time;
+				if (replaySpeed > 0)
+				{
+					Int64 due = start + (Int64)((record.time - first) / replaySpeed);
+					Int64 now;
+					while (running && (now = hostMicros()) < due)
+					{
+						discardCommands();
+						waitForWork((due - now + 999) / 1000);
+					}
+				}
+				switch (record.kind)
+				{
+					case CAPTURE_READ:
+						if (record.len)
+						{
+							received(record.data, record.len, record.time);
+							notifyUi();
+							reads++;
+							bytes += record.len;
+						}
+						break;
+					case CAPTURE_OPENED:
+						opened(std::string((const char*)record.data, record.len), record.time);
+						break;
+					case CAPTURE_LOST:
+						publish(SerialEvent::RECONNECTING);
+						notifyUi();
+						break;
+				}
+			}
+			double took = (hostMicros() - start) / 1e6;
+			double recorded = first < 0 ? 0 : (last - first) / 1e6;
+			std::cout<<"Replayed "<<reads<<" reads, "<<bytes<<" bytes, "<<recorded<<" s of traffic in "<<took<<" s ("<<(took > 0 ? recorded / took : 0)<<"x)\n";
+			reader.close();
+		}
+		while (running)
+		{
+			discardCommands();
+			waitForWork(-1);
+		}
+	}
+	#endif
+
+	void run()
+	{
+		traceThread("serial");
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			if (!replayPath.empty())
+			{
+				replay();
+				return;
+			}
+		#endif
+		while (running)
+		{
+			SerialCommand cmd;
+			while (commands.pop(cmd))
+			{
+				#if EE_PLATFORM == EE_PLATFORM_LINUX
+					execute(cmd);
+				#endif
+			}
+
+			int timeoutMs = -1;
+			#if EE_PLATFORM == EE_PLATFORM_LINUX
+				bool portsChanged = watcher.changed();
+				if (portsChanged)
+				{
+					publish(SerialEvent::PORTS);
+					notifyUi();
+				}
+				if (reconnecting && (portsChanged || hostMicros() >= nextRetry))
+				{
+					nextRetry = hostMicros() + RECONNECT_MS * 1000;
+					tryReconnect();
+				}
+				bool gotData = isOpen() && readPort();
+				if (gotData)
+				{
+					notifyUi();
+				}
+				//every pass, a port that never stops talking still gets its pings and retransmits on time
+				if (isOpen())
+				{
+					timeoutMs = ping();
+					int ackMs = sendPending();
+					if (ackMs >= 0)
+					{
+						timeoutMs = std::min(timeoutMs, ackMs);
+					}
+				}
+				if (gotData)
+				{
+					continue; //more may be right behind it
+				}
+				if (!isOpen() && reconnecting)
+				{
+					timeoutMs = RECONNECT_MS;
+				}
+			#endif
+			if (running)
+			{
+				capture.flush(); //only while there's nothing else to do, and a crash loses at most what's in the buffer
+				waitForWork(timeoutMs);
+			}
+		}
+		#if EE_PLATFORM == EE_PLATFORM_LINUX
+			closeNow();
+		#endif
+		capture.close();
+	}
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef JEOPARDY_SERIALTUNING_HPP
+#define JEOPARDY_SERIALTUNING_HPP
+
+#include <eepp/ee.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#if EE_PLATFORM == EE_PLATFORM_LINUX
+	#include <linux/serial.h>
+	#include <sys/ioctl.h>
+	#include <termios.h>
+#endif
+
+#if EE_PLATFORM == EE_PLATFORM_LINUX
+//the kernel's struct termios2, for baud rates termios has no constant for
+//asm/termbits.h has the real one but can't be included next to termios.h
+struct KernelTermios2 {
+	tcflag_t c_iflag;
+	tcflag_t c_oflag;
+	tcflag_t c_cflag;
+	tcflag_t c_lflag;
+	cc_t c_line;
+	cc_t c_cc[19];
+	speed_t c_ispeed;
+	speed_t c_ospeed;
+};
+#define JP_TCGETS2 _IOR('T', 0x2A, KernelTermios2)
+#define JP_TCSETS2 _IOW('T', 0x2B, KernelTermios2)
+#ifndef BOTHER
+	#define BOTHER 0010000
+#endif
+
+//any baud rate the driver can do, false if it can't
+inline bool setBaud(int fd, Uint32 baud)
+{
+	KernelTermios2 tio;
+	if (ioctl(fd, JP_TCGETS2, &tio) < 0)
+	{
+		return false;
+	}
+	tio.c_cflag &= ~CBAUD;
+	tio.c_cflag |= BOTHER;
+	tio.c_ispeed = baud;
+	tio.c_ospeed = baud;
+	return ioctl(fd, JP_TCSETS2, &tio) == 0;
+}
+#endif
+
+//what actually got applied to a port, read back from the driver rather than assumed
+struct SerialTuning {
+	Uint32 baud = 0; //0 if it couldn't be read
+	bool raw = false; //no line discipline processing on input or output
+	int vmin = -1;
+	int vtime = -1;
+	int lowLatency = -1; //ASYNC_LOW_LATENCY, -1 if the driver doesn't do TIOCGSERIAL
+	int latencyTimer = -1; //ms, usb-serial adapters that have one (FTDI), -1 otherwise
+
+	std::string describe() const
+	{
+		char text[160];
+		snprintf(text, sizeof(text), "%u baud%s, VMIN %d VTIME %d, low latency %s, latency timer %s", baud,
+				 raw ? " raw" : " NOT raw", vmin, vtime, lowLatency < 0 ? "n/a" : (lowLatency ? "on" : "off"),
+				 latencyTimer < 0 ? "n/a" : (std::to_string(latencyTimer) + " ms").c_str());
+		return text;
+	}
+};
+
+//usb-serial adapters hold bytes back to fill usb packets, for ftdi that's a 16ms timer by default
+//ASYNC_LOW_LATENCY asks the driver to push every byte up right away (ftdi_sio drops its timer to 1ms for it),
+//the sysfs latency_timer is set too for drivers that only take it there, either may need permissions we don't have
+//fd can be any fd on the tty, the settings belong to the device
+inline SerialTuning tunePort(int fd, const std::string& device)
+{
+	SerialTuning tuning;
+	#if EE_PLATFORM == EE_PLATFORM_LINUX
+		serial_struct serial;
+		if (ioctl(fd, TIOCGSERIAL, &serial) == 0)
+		{
+			if (!(serial.flags & ASYNC_LOW_LATENCY))
+			{
+				serial.flags |= ASYNC_LOW_LATENCY;
+				ioctl(fd, TIOCSSERIAL, &serial);
+			}
+			if (ioctl(fd, TIOCGSERIAL, &serial) == 0)
+			{
+				tuning.lowLatency = (serial.flags & ASYNC_LOW_LATENCY) ? 1 : 0;
+			}
+		}
+
+		std::string timerPath = "/sys/class/tty/" + std::filesystem::path(device).filename().string() + "/device/latency_timer";
+		{
+			std::ofstream timer(timerPath);
+			if (timer)
+			{
+				timer << 1;
+			}
+		}
+		std::ifstream timer(timerPath);
+		if (timer)
+		{
+			timer >> tuning.latencyTimer;
+		}
+
+		termios tty;
+		if (tcgetattr(fd, &tty) == 0)
+		{
+			tuning.raw = !(tty.c_lflag & (ICANON | ECHO | ISIG | IEXTEN)) && !(tty.c_iflag & (ICRNL | INLCR | IGNCR | IXON | ISTRIP)) && !(tty.c_oflag & OPOST);
+			tuning.vmin = tty.c_cc[VMIN];
+			tuning.vtime = tty.c_cc[VTIME];
+		}
+		KernelTermios2 tio;
+		if (ioctl(fd, JP_TCGETS2, &tio) == 0)
+		{
+			tuning.baud = tio.c_ispeed;
+		}
+	#endif
+	return tuning;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef JEOPARDY_SPSCRING_HPP
+#define JEOPARDY_SPSCRING_HPP
+
+#include <atomic>
+#include <cstddef>
+
+//lock free ring between exactly two threads, one only ever push()es and the other only ever pop()s
+//head and tail live on their own cache lines and each side keeps a copy of the other side's index,
+//so the shared counters are only read again when the ring looks full (or empty)
+template <typename T, size_t N>
+struct SpscRing {
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of 2");
+
+	//producer side, false if the ring is full
+	bool push(const T& item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tailCache == N)
+		{
+			tailCache = tail.load(std::memory_order_acquire);
+			if (h - tailCache == N)
+			{
+				return false;
+			}
+		}
+		items[h & (N - 1)] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//consumer side, false if there was nothing to take
+	bool pop(T& item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t == headCache)
+		{
+			headCache = head.load(std::memory_order_acquire);
+			if (t == headCache)
+			{
+				return false;
+			}
+		}
+		item = items[t & (N - 1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//consumer side
+	bool empty() const
+	{
+		return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire);
+	}
+
+	alignas(64) std::atomic<size_t> head{0};
+	size_t tailCache = 0; //producer's copy
+	alignas(64) std::atomic<size_t> tail{0};
+	size_t headCache = 0; //consumer's copy
+	alignas(64) T items[N];
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef JEOPARDY_TRACE_HPP
+#define JEOPARDY_TRACE_HPP
+
+#include <eepp/ee.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clocksync.hpp"
+
+//timeline of what every thread was doing, written as a chrome trace (chrome://tracing or ui.perfetto.dev)
+//JpController --trace file records it, F4 writes out what's there so far, the rest is written at exit
+//every thread appends to its own ring with no locks, the newest TRACE_EVENTS per thread are kept, so a long
+//show still has the last minutes of it when something felt slow
+//with tracing off an event is one relaxed load, while the rings are copied out for writing events are dropped
+#define TRACE_EVENTS 131072
+
+struct TraceEvent {
+	const char* name; //string literals only, the pointer is all that's kept
+	Int64 start; //hostMicros()
+	Int64 duration; //complete events
+	Int64 arg;
+	char phase; //'X' complete, 'i' instant
+};
+
+//one writer, its thread, the reader only copies it out while the writer is held off
+struct TraceBuffer {
+	std::atomic<Uint64> count{0}; //events ever added, event n is events[n % TRACE_EVENTS]
+	std::atomic<bool> writing{false}; //an event is going in, Tracer::write() waits for it
+	int tid;
+	std::string thread;
+	TraceEvent events[TRACE_EVENTS];
+};
+
+struct Tracer {
+	std::atomic<bool> enabled{false};
+	std::atomic<bool> copying{false}; //write() is reading the rings, nothing may go into them
+	std::string path;
+	Int64 start = 0; //the trace's zero
+	std::mutex mutex; //threads registering and the writer, never held by an event
+	std::vector<TraceBuffer*> buffers; //never freed, a thread's events outlive it until the trace is written
+
+	void enable(const std::string& file)
+	{
+		path = file;
+		start = hostMicros();
+		enabled = true;
+	}
+
+	TraceBuffer* add(const std::string& thread)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		TraceBuffer* buffer = new TraceBuffer();
+		buffer->tid = buffers.size() + 1;
+		buffer->thread = thread.empty() ? "thread " + std::to_string(buffer->tid) : thread;
+		buffers.push_back(buffer);
+		return buffer;
+	}
+
+	bool write()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		FILE* out = fopen(path.c_str(), "w");
+		if (!out)
+		{
+			return false;
+		}
+
+		//copied with every writer held off, the formatting is done after they're let go again
+		std::vector<std::vector<TraceEvent>> copies(buffers.size());
+		copying = true;
+		for (TraceBuffer* buffer : buffers)
+		{
+			while (buffer->writing.load(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+			}
+		}
+		for (size_t b = 0; b < buffers.size(); b++)
+		{
+			Uint64 end = buffers[b]->count.load(std::memory_order_acquire);
+			for (Uint64 n = end - std::min<Uint64>(end, TRACE_EVENTS); n < end; n++)
+			{
+				copies[b].push_back(buffers[b]->events[n % TRACE_EVENTS]);
+			}
+		}
+		copying.store(false, std::memory_order_release);
+
+		fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"JpController\"}}");
+		for (size_t b = 0; b < buffers.size(); b++)
+		{
+			const TraceBuffer* buffer = buffers[b];
+			fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", buffer->tid, buffer->thread.c_str());
+			for (const TraceEvent& e : copies[b])
+			{
+				fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %lld", e.name, e.phase, buffer->tid, (long long)(e.start - start));
+				if (e.phase == 'X')
+				{
+					fprintf(out, ", \"dur\": %lld", (long long)e.duration);
+				}
+				else
+				{
+					fprintf(out, ", \"s\": \"t\"");
+				}
+				fprintf(out, ", \"args\": {\"value\": %lld}}", (long long)e.arg);
+			}
+		}
+		fprintf(out, "\n]}\n");
+		return fclose(out) == 0;
+	}
+};
+
+inline Tracer& tracer()
+{
+	static Tracer instance;
+	return instance;
+}
+
+inline TraceBuffer*& traceBuffer()
+{
+	thread_local TraceBuffer* buffer = NULL;
+	return buffer;
+}
+
+//names the calling thread in the trace, before its first event
+inline void traceThread(const char* name)
+{
+	if (tracer().enabled.load(std::memory_order_relaxed) && !traceBuffer())
+	{
+		traceBuffer() = tracer().add(name);
+	}
+}
+
+inline void traceEvent(const char* name, char phase, Int64 start, Int64 duration, Int64 arg)
+{
+	if (!tracer().enabled.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+	TraceBuffer* buffer = traceBuffer();
+	if (!buffer)
+	{
+		buffer = traceBuffer() = tracer().add("");
+	}
+	//seq_cst both ways with write(): either it sees this event going in and waits, or this sees it copying
+	buffer->writing = true;
+	if (!tracer().copying)
+	{
+		Uint64 n = buffer->count.load(std::memory_order_relaxed);
+		buffer->events[n % TRACE_EVENTS] = {name, start, duration, arg, phase};
+		buffer->count.store(n + 1, std::memory_order_release);
+	}
+	buffer->writing.store(false, std::memory_order_release);
+}
+
+inline void traceInstant(const char* name, Int64 arg = 0)
+{
+	traceEvent(name, 'i', hostMicros(), 0, arg);
+}
+
+//a complete event from here to the end of the scope
+struct TraceScope {
+	const char* name;
+	Int64 arg;
+	Int64 start;
+
+	TraceScope(const char* name, Int64 arg = 0) : name(name), arg(arg), start(tracer().enabled.load(std::memory_order_relaxed) ? hostMicros() : 0) {}
+
+	~TraceScope()
+	{
+		if (start)
+		{
+			traceEvent(name, 'X', start, hostMicros() - start, arg);
+		}
+	}
+};
+
+#endif